@@ -0,0 +1,92 @@
+// Cache for the build information forwarded from the sub-projects
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbuildinfocache.h"
+
+namespace
+{
+	uint hashPaths(const KDevelop::Path::List& paths)
+	{
+		uint hash = paths.size();
+		for(const auto& path : paths)
+			hash = hash * 31 + qHash(path);
+		return hash;
+	}
+
+	uint hashDefines(const QHash<QString, QString>& defines)
+	{
+		// Independent of the iteration order
+		uint hash = defines.size();
+		for(auto it = defines.begin(); it != defines.end(); ++it)
+			hash += qHash(it.key()) ^ qHash(it.value());
+		return hash;
+	}
+}
+
+bool operator==(const CatkinBuildInfo& a, const CatkinBuildInfo& b)
+{
+	// Interned lists share their data, which makes these comparisons cheap
+	return a.includeDirectories == b.includeDirectories
+		&& a.frameworkDirectories == b.frameworkDirectories
+		&& a.defines == b.defines
+		&& a.extraArguments == b.extraArguments;
+}
+
+uint qHash(const CatkinBuildInfo& info, uint seed)
+{
+	return seed ^ hashPaths(info.includeDirectories) ^ (hashPaths(info.frameworkDirectories) * 31)
+		^ hashDefines(info.defines) ^ qHash(info.extraArguments);
+}
+
+bool CatkinBuildInfoCache::lookup(CatkinSubProject* project, const KDevelop::ProjectBaseItem* key, CatkinBuildInfo* info) const
+{
+	QReadLocker lock(&m_lock);
+
+	auto projectIt = m_entries.constFind(project);
+	if(projectIt == m_entries.constEnd())
+		return false;
+
+	auto it = projectIt->constFind(key);
+	if(it == projectIt->constEnd())
+		return false;
+
+	*info = *it;
+	return true;
+}
+
+CatkinBuildInfo CatkinBuildInfoCache::insert(CatkinSubProject* project, const KDevelop::ProjectBaseItem* key, const CatkinBuildInfo& info)
+{
+	QWriteLocker lock(&m_lock);
+
+	CatkinBuildInfo interned = internLocked(info);
+	m_entries[project].insert(key, interned);
+
+	return interned;
+}
+
+CatkinBuildInfo CatkinBuildInfoCache::intern(const CatkinBuildInfo& info)
+{
+	QWriteLocker lock(&m_lock);
+	return internLocked(info);
+}
+
+CatkinBuildInfo CatkinBuildInfoCache::internLocked(const CatkinBuildInfo& info)
+{
+	CatkinBuildInfo interned;
+	interned.includeDirectories = m_pathLists.intern(info.includeDirectories, hashPaths(info.includeDirectories));
+	interned.frameworkDirectories = m_pathLists.intern(info.frameworkDirectories, hashPaths(info.frameworkDirectories));
+	interned.defines = m_defines.intern(info.defines, hashDefines(info.defines));
+	interned.extraArguments = m_arguments.intern(info.extraArguments, qHash(info.extraArguments));
+
+	return interned;
+}
+
+void CatkinBuildInfoCache::invalidate(CatkinSubProject* project)
+{
+	QWriteLocker lock(&m_lock);
+	m_entries.remove(project);
+
+	m_pathLists.prune();
+	m_defines.prune();
+	m_arguments.prune();
+}
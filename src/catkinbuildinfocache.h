@@ -0,0 +1,97 @@
+// Cache for the build information forwarded from the sub-projects
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINBUILDINFOCACHE_H
+#define CATKINBUILDINFOCACHE_H
+
+#include <util/path.h>
+
+#include <QHash>
+#include <QMultiHash>
+#include <QReadWriteLock>
+#include <QString>
+
+class CatkinSubProject;
+
+namespace KDevelop
+{
+	class ProjectBaseItem;
+}
+
+struct CatkinBuildInfo
+{
+	KDevelop::Path::List includeDirectories;
+	KDevelop::Path::List frameworkDirectories;
+	QHash<QString, QString> defines;
+	QString extraArguments;
+};
+
+bool operator==(const CatkinBuildInfo& a, const CatkinBuildInfo& b);
+uint qHash(const CatkinBuildInfo& info, uint seed = 0);
+
+/**
+ * Build information per sub-project target (or file, if it does not belong
+ * to a target).
+ *
+ * Most packages in a workspace share the same include directories and
+ * defines, so the lists are interned: equal lists share one implicitly
+ * shared copy, no matter how many packages use them.
+ *
+ * The cache is thread-safe, it is queried from parse jobs.
+ **/
+class CatkinBuildInfoCache
+{
+public:
+	bool lookup(CatkinSubProject* project, const KDevelop::ProjectBaseItem* key, CatkinBuildInfo* info) const;
+
+	//! Stores @p info and returns the interned version of it
+	CatkinBuildInfo insert(CatkinSubProject* project, const KDevelop::ProjectBaseItem* key, const CatkinBuildInfo& info);
+
+	//! Returns the interned version of @p info without caching it
+	CatkinBuildInfo intern(const CatkinBuildInfo& info);
+
+	//! Drops everything cached for @p project, and the interned lists no one uses any more
+	void invalidate(CatkinSubProject* project);
+private:
+	CatkinBuildInfo internLocked(const CatkinBuildInfo& info);
+
+	template<class T>
+	class InternPool
+	{
+	public:
+		T intern(const T& value, uint hash)
+		{
+			for(auto it = m_values.constFind(hash); it != m_values.constEnd() && it.key() == hash; ++it)
+			{
+				if(*it == value)
+					return *it;
+			}
+
+			m_values.insert(hash, value);
+			return value;
+		}
+
+		//! Drops the values only the pool still refers to
+		void prune()
+		{
+			for(auto it = m_values.begin(); it != m_values.end();)
+			{
+				if(it->isDetached())
+					it = m_values.erase(it);
+				else
+					++it;
+			}
+		}
+	private:
+		QMultiHash<uint, T> m_values;
+	};
+
+	mutable QReadWriteLock m_lock;
+	QHash<CatkinSubProject*, QHash<const KDevelop::ProjectBaseItem*, CatkinBuildInfo>> m_entries;
+
+	InternPool<KDevelop::Path::List> m_pathLists;
+	InternPool<QHash<QString, QString>> m_defines;
+	InternPool<QString> m_arguments;
+};
+
+#endif
@@ -0,0 +1,455 @@
+// Builds the packages of a catkin workspace in dependency order
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbuildjob.h"
+#include "catkinbuildoutputmodel.h"
+#include "catkinjobserver.h"
+#include "catkinmanager.h"
+#include "catkinsubproject.h"
+
+#include <outputview/outputdelegate.h>
+
+#include <interfaces/iproject.h>
+
+#include <KLocalizedString>
+
+#include <ThreadWeaver/ThreadWeaver>
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+
+CatkinBuildJob::CatkinBuildJob(CatkinManager* manager, KDevelop::IProject* workspace, Command command, QObject* parent)
+ : KDevelop::OutputJob(parent)
+ , m_manager(manager)
+ , m_workspace(workspace)
+ , m_command(command)
+ , m_maxConcurrency(QThread::idealThreadCount())
+ , m_jobs(QThread::idealThreadCount())
+ , m_queue(new ThreadWeaver::Queue(this))
+{
+	m_queue->setMaximumNumberOfThreads(1);
+	connect(this, &CatkinBuildJob::prepared, this, &CatkinBuildJob::startBuild);
+	connect(this, &CatkinBuildJob::stampsWritten, this, [this](){
+		emitResult();
+	});
+
+	setCapabilities(Killable);
+	setStandardToolView(KDevelop::IOutputView::BuildView);
+	setBehaviours(KDevelop::IOutputView::AllowUserClose | KDevelop::IOutputView::AutoScroll);
+
+	switch(command)
+	{
+		case Build:   setTitle(i18n("Build %1", workspace->name())); break;
+		case Clean:   setTitle(i18n("Clean %1", workspace->name())); break;
+		case Install: setTitle(i18n("Install %1", workspace->name())); break;
+	}
+}
+
+CatkinBuildJob::~CatkinBuildJob()
+{
+	// Make sure the worker does not touch us after destruction
+	m_queue->dequeue();
+	m_queue->finish();
+}
+
+void CatkinBuildJob::setPackages(const QList<CatkinSubProject*>& packages)
+{
+	m_selection = packages;
+}
+
+void CatkinBuildJob::setInstallPrefix(const KDevelop::Path& prefix)
+{
+	m_installPrefix = prefix;
+}
+
+void CatkinBuildJob::setMaximumConcurrency(int packages)
+{
+	m_maxConcurrency = qMax(1, packages);
+}
+
+void CatkinBuildJob::setOnlyChanged(bool onlyChanged)
+{
+	m_onlyChanged = onlyChanged;
+}
+
+void CatkinBuildJob::setDryRun(bool dryRun)
+{
+	m_dryRun = dryRun;
+	if(dryRun)
+		setTitle(i18n("Packages to build in %1", m_workspace->name()));
+}
+
+void CatkinBuildJob::setJobs(int jobs)
+{
+	m_jobs = qMax(1, jobs);
+}
+
+void CatkinBuildJob::start()
+{
+	m_model = new CatkinBuildOutputModel(m_workspace);
+	setModel(m_model);
+	setDelegate(new KDevelop::OutputDelegate);
+	startOutput();
+
+	m_cmake = QStandardPaths::findExecutable(QStringLiteral("cmake"));
+	if(m_cmake.isEmpty())
+	{
+		setError(UserDefinedError);
+		setErrorText(i18n("Could not find cmake"));
+		emitResult();
+		return;
+	}
+
+	m_environment = CatkinManager::buildEnvironment(m_workspace);
+
+	// The sub-projects are only touched here, the worker gets copies
+	const auto packages = CatkinDependencyGraph::packages(m_manager->subprojects(m_workspace));
+
+	QStringList names;
+	for(auto project : m_selection)
+		names << project->name();
+
+	m_queue->enqueue(ThreadWeaver::make_job([this, packages, names](){
+		prepare(packages, names);
+		emit prepared(QPrivateSignal());
+	}));
+}
+
+void CatkinBuildJob::prepare(const QVector<CatkinDependencyGraph::Package>& packages, QStringList names)
+{
+	m_graph.reset(new CatkinDependencyGraph(packages));
+
+	// Selected packages, plus everything they depend on
+	if(names.isEmpty())
+		names = m_graph->packageNames();
+
+	if(m_command != Clean)
+		m_buildSelection = m_graph->dependencyClosure(names);
+	else
+	{
+		for(const QString& name : names)
+		{
+			if(m_graph->package(name))
+				m_buildSelection.insert(name);
+		}
+	}
+
+	if(m_command == Build && (m_onlyChanged || m_dryRun))
+	{
+		m_rebuildSet.reset(new CatkinRebuildSet(*m_graph, m_buildSelection, CatkinRebuildSet::Built, m_dryRun));
+
+		for(auto it = m_buildSelection.begin(); it != m_buildSelection.end();)
+		{
+			if(m_rebuildSet->contains(*it))
+				++it;
+			else
+				it = m_buildSelection.erase(it);
+		}
+	}
+
+	if(m_command != Clean)
+		m_cyclicPackages = m_graph->cyclicPackages(m_buildSelection);
+}
+
+void CatkinBuildJob::startBuild()
+{
+	if(m_killed)
+		return;
+
+	if(m_rebuildSet)
+	{
+		for(const auto& entry : m_rebuildSet->entries())
+			appendLine(entry.package, i18n("Needs building: %1", m_rebuildSet->reasonText(entry)));
+	}
+
+	if(m_dryRun)
+	{
+		if(m_buildSelection.isEmpty())
+			appendLine(m_workspace->name(), i18n("All packages are up to date"));
+
+		emitResult();
+		return;
+	}
+
+	// There is no order to build these in
+	if(!m_cyclicPackages.isEmpty())
+	{
+		setError(UserDefinedError);
+		setErrorText(i18n("Dependency cycle between the packages %1",
+			m_cyclicPackages.join(QStringLiteral(", "))
+		));
+		emitResult();
+		return;
+	}
+
+	m_jobServer = new CatkinJobServer(m_jobs, this);
+	if(m_jobServer->isValid())
+		m_environment.insert(QStringLiteral("MAKEFLAGS"), m_jobServer->makeFlags());
+	connect(m_jobServer, &CatkinJobServer::tokensAvailable, this, &CatkinBuildJob::startPackages);
+
+	for(const QString& name : m_buildSelection)
+	{
+		Package package;
+		package.project = m_graph->package(name);
+		package.commands = commands(package.project);
+
+		// Cleaning does not need any particular order
+		if(m_command != Clean)
+		{
+			for(const QString& dependency : m_graph->dependencies(name))
+			{
+				if(m_buildSelection.contains(dependency))
+					package.dependencies.insert(dependency);
+			}
+		}
+
+		m_pending.insert(name, package);
+	}
+
+	m_total = m_pending.size();
+	setTotalAmount(KJob::Items, m_total);
+
+	startPackages();
+	checkDone();
+}
+
+bool CatkinBuildJob::doKill()
+{
+	// A prepared() that is already queued must not start anything
+	m_killed = true;
+	m_queue->dequeue();
+
+	for(auto it = m_processes.begin(); it != m_processes.end(); ++it)
+	{
+		it.key()->disconnect(this);
+		it.key()->kill();
+		it.key()->waitForFinished(1000);
+	}
+
+	m_processes.clear();
+	m_pending.clear();
+	m_active.clear();
+
+	return true;
+}
+
+QList<QStringList> CatkinBuildJob::commands(CatkinSubProject* project) const
+{
+	const QString buildPath = project->buildPath().toLocalFile();
+	const bool configured = QFile::exists(buildPath + QStringLiteral("/CMakeCache.txt"));
+
+	// The jobserver only reaches make, CMake configures with the Makefile
+	// generator unless told otherwise
+	const QString generator = configured
+		? m_manager->cmakeCacheValue(project, "CMAKE_GENERATOR")
+		: m_environment.value(QStringLiteral("CMAKE_GENERATOR"), QStringLiteral("Unix Makefiles"));
+
+	// Otherwise split the make jobs between the packages running at the same time
+	QStringList jobs;
+	if(!m_jobServer->isValid() || generator != QLatin1String("Unix Makefiles"))
+		jobs << QStringLiteral("--") << QStringLiteral("-j%1").arg(qMax(1, m_jobs / m_maxConcurrency));
+
+	QList<QStringList> commands;
+
+	if(m_command == Clean)
+	{
+		// Nothing to clean in a package that was never configured
+		if(configured)
+			commands << QStringList{QStringLiteral("--build"), buildPath, QStringLiteral("--target"), QStringLiteral("clean")};
+
+		return commands;
+	}
+
+	if(!configured)
+	{
+		commands << QStringList{
+			project->path().toLocalFile(),
+			QStringLiteral("-DCATKIN_DEVEL_PREFIX=") + CatkinManager::develSpace(m_workspace).toLocalFile(),
+			QStringLiteral("-DCMAKE_INSTALL_PREFIX=") + CatkinManager::installSpace(m_workspace).toLocalFile()
+		};
+	}
+
+	if(m_command == Install && m_installPrefix.isValid())
+	{
+		commands << (QStringList{QStringLiteral("--build"), buildPath} + jobs);
+		commands << QStringList{
+			QStringLiteral("-DCMAKE_INSTALL_PREFIX=") + m_installPrefix.toLocalFile(),
+			QStringLiteral("-P"), QStringLiteral("cmake_install.cmake")
+		};
+	}
+	else if(m_command == Install)
+		commands << (QStringList{QStringLiteral("--build"), buildPath, QStringLiteral("--target"), QStringLiteral("install")} + jobs);
+	else
+		commands << (QStringList{QStringLiteral("--build"), buildPath} + jobs);
+
+	return commands;
+}
+
+void CatkinBuildJob::startPackages()
+{
+	if(!m_failed.isEmpty())
+		return;
+
+	auto it = m_pending.begin();
+	while(m_active.size() < m_maxConcurrency && it != m_pending.end())
+	{
+		if(!it->dependencies.isEmpty())
+		{
+			++it;
+			continue;
+		}
+
+		// The first make job of each package, the jobserver hands out the others
+		if(!m_jobServer->tryAcquire())
+			break;
+
+		QString name = it.key();
+		m_model->startPackage(name, it->project->buildPath(), it->project->path());
+		m_active.insert(name, *it);
+		it = m_pending.erase(it);
+
+		runNext(name);
+	}
+}
+
+void CatkinBuildJob::runNext(const QString& name)
+{
+	Package& package = m_active[name];
+	if(package.commands.isEmpty())
+	{
+		// Never finish synchronously, we might be called from startPackages()
+		QTimer::singleShot(0, this, [this, name](){
+			packageFinished(name, true);
+		});
+		return;
+	}
+
+	QString buildPath = package.project->buildPath().toLocalFile();
+	QDir().mkpath(buildPath);
+
+	QStringList arguments = package.commands.takeFirst();
+	appendLine(name, QStringLiteral("cmake ") + arguments.join(QLatin1Char(' ')));
+
+	QProcess* process = new CatkinJobServerProcess(m_jobServer, this);
+	process->setProcessChannelMode(QProcess::MergedChannels);
+	process->setProcessEnvironment(m_environment);
+	process->setWorkingDirectory(buildPath);
+
+	connect(process, &QProcess::readyRead, this, [this, process](){
+		processOutput(process);
+	});
+	connect(process, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this, [this, process](){
+		processFinished(process);
+	});
+	connect(process, &QProcess::errorOccurred, this, [this, process](QProcess::ProcessError error){
+		if(error == QProcess::FailedToStart)
+			processFinished(process);
+	}, Qt::QueuedConnection);
+
+	m_processes.insert(process, name);
+	process->start(m_cmake, arguments);
+}
+
+void CatkinBuildJob::processOutput(QProcess* process)
+{
+	m_model->appendOutput(m_processes.value(process), process->readAll());
+}
+
+void CatkinBuildJob::processFinished(QProcess* process)
+{
+	auto it = m_processes.find(process);
+	if(it == m_processes.end())
+		return;
+
+	QString name = *it;
+	processOutput(process);
+	m_model->endOutput(name);
+
+	m_processes.erase(m_processes.find(process));
+
+	bool success = process->error() != QProcess::FailedToStart
+		&& process->exitStatus() == QProcess::NormalExit
+		&& process->exitCode() == 0;
+
+	process->deleteLater();
+
+	if(success)
+		runNext(name);
+	else
+		packageFinished(name, false);
+}
+
+void CatkinBuildJob::packageFinished(const QString& name, bool success)
+{
+	Package package = m_active.take(name);
+	m_jobServer->release();
+
+	if(success)
+	{
+		for(auto& pending : m_pending)
+			pending.dependencies.remove(name);
+
+		if(m_command != Clean)
+			m_manager->packageBuilt(package.project);
+
+		if(m_rebuildSet)
+		{
+			// Packages configured by this build are hashed now
+			m_queue->enqueue(ThreadWeaver::make_job([this, name](){
+				m_rebuildSet->markDone(name);
+			}));
+		}
+	}
+	else
+	{
+		appendLine(name, i18n("Failed"));
+		m_failed << name;
+	}
+
+	m_model->finishPackage(name);
+
+	m_done++;
+	setProcessedAmount(KJob::Items, m_done);
+	emitPercent(m_done, m_total);
+
+	startPackages();
+	checkDone();
+}
+
+void CatkinBuildJob::checkDone()
+{
+	if(!m_active.isEmpty())
+		return;
+
+	// Waiting for a jobserver token, tokensAvailable() starts the next
+	// package. Cycles were ruled out in startBuild().
+	if(m_failed.isEmpty() && !m_pending.isEmpty())
+		return;
+
+	if(!m_failed.isEmpty())
+	{
+		setError(UserDefinedError);
+		setErrorText(i18n("Failed packages: %1", m_failed.join(QStringLiteral(", "))));
+	}
+
+	// Finish after the stamps of the last packages
+	if(m_rebuildSet)
+	{
+		m_queue->enqueue(ThreadWeaver::make_job([this](){
+			emit stampsWritten(QPrivateSignal());
+		}));
+		return;
+	}
+
+	emitResult();
+}
+
+void CatkinBuildJob::appendLine(const QString& package, const QString& line)
+{
+	m_model->appendLine(package, line);
+}
@@ -0,0 +1,163 @@
+// Builds the packages of a catkin workspace in dependency order
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINBUILDJOB_H
+#define CATKINBUILDJOB_H
+
+#include <outputview/outputjob.h>
+
+#include <util/path.h>
+
+#include "catkindependencygraph.h"
+#include "catkinrebuildset.h"
+
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QProcessEnvironment>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+#include <memory>
+
+class QProcess;
+
+namespace ThreadWeaver
+{
+	class Queue;
+}
+
+class CatkinBuildOutputModel;
+class CatkinJobServer;
+class CatkinManager;
+class CatkinSubProject;
+
+/**
+ * Runs one CMake build per package, in parallel where the package
+ * dependency graph (from the package.xml files) allows it.
+ *
+ * Unconfigured packages are configured first, all packages share the
+ * devel space of the workspace. The make jobs are handed out by a
+ * CatkinJobServer, so a package gets more of them while fewer packages
+ * are running. Packages using another generator than the Makefile one
+ * get a fixed share of the jobs instead.
+ *
+ * If a package fails, no further packages are started.
+ *
+ * With setOnlyChanged(), Build skips packages whose sources did not change.
+ *
+ * The package manifests are read and the sources hashed in a worker thread,
+ * the processes are started once that is done.
+ **/
+class CatkinBuildJob : public KDevelop::OutputJob
+{
+Q_OBJECT
+public:
+	enum Command
+	{
+		Build,
+		Clean,
+		Install
+	};
+
+	CatkinBuildJob(CatkinManager* manager, KDevelop::IProject* workspace, Command command, QObject* parent = nullptr);
+	~CatkinBuildJob() override;
+
+	/**
+	 * Restricts the job to @p packages. Build and Install also process
+	 * the dependencies of the packages. The default is all packages.
+	 **/
+	void setPackages(const QList<CatkinSubProject*>& packages);
+
+	//! Install into @p prefix instead of the configured install space
+	void setInstallPrefix(const KDevelop::Path& prefix);
+
+	//! Number of packages processed at the same time
+	void setMaximumConcurrency(int packages);
+
+	//! Total number of make jobs, shared by all packages
+	void setJobs(int jobs);
+
+	//! Build only packages which changed since their last build, see CatkinRebuildSet
+	void setOnlyChanged(bool onlyChanged);
+
+	/**
+	 * Only lists the packages Build would build with setOnlyChanged(),
+	 * nothing is run and nothing is written to the build directories.
+	 **/
+	void setDryRun(bool dryRun);
+
+	void start() override;
+Q_SIGNALS:
+	//! Emitted from the worker thread when the package selection is known
+	void prepared(QPrivateSignal);
+
+	//! Emitted from the worker thread once the build stamps are written
+	void stampsWritten(QPrivateSignal);
+protected:
+	bool doKill() override;
+private:
+	struct Package
+	{
+		CatkinSubProject* project = nullptr;
+
+		//! Dependencies which are not done yet
+		QSet<QString> dependencies;
+
+		//! Remaining commands, run in the package build directory
+		QList<QStringList> commands;
+	};
+
+	QList<QStringList> commands(CatkinSubProject* project) const;
+
+	//! Reads the dependency graph and selects the packages, runs in the worker thread
+	void prepare(const QVector<CatkinDependencyGraph::Package>& packages, QStringList names);
+
+	//! Continues start() in the main thread once the worker is done
+	void startBuild();
+
+	void startPackages();
+	void runNext(const QString& name);
+	void processOutput(QProcess* process);
+	void processFinished(QProcess* process);
+	void packageFinished(const QString& name, bool success);
+	void checkDone();
+
+	void appendLine(const QString& package, const QString& line);
+
+	CatkinManager* m_manager;
+	KDevelop::IProject* m_workspace;
+	Command m_command;
+
+	QList<CatkinSubProject*> m_selection;
+	KDevelop::Path m_installPrefix;
+	int m_maxConcurrency;
+	int m_jobs;
+	bool m_onlyChanged = false;
+	bool m_dryRun = false;
+	bool m_killed = false;
+
+	//! Written by the worker before prepared(), the worker also writes the build stamps
+	ThreadWeaver::Queue* m_queue;
+	std::unique_ptr<CatkinDependencyGraph> m_graph;
+	QSet<QString> m_buildSelection;
+	QStringList m_cyclicPackages;
+	std::unique_ptr<CatkinRebuildSet> m_rebuildSet;
+
+	QString m_cmake;
+	QProcessEnvironment m_environment;
+	CatkinBuildOutputModel* m_model = nullptr;
+	CatkinJobServer* m_jobServer = nullptr;
+
+	//! Packages waiting for their dependencies, ordered for reproducible builds
+	QMap<QString, Package> m_pending;
+	QHash<QString, Package> m_active;
+	QHash<QProcess*, QString> m_processes;
+
+	QStringList m_failed;
+	qulonglong m_total = 0;
+	qulonglong m_done = 0;
+};
+
+#endif
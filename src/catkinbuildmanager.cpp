@@ -0,0 +1,108 @@
+// Build manager for catkin projects
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbuildmanager.h"
+#include "catkinmanager.h"
+#include "catkintestjob.h"
+
+#include <interfaces/iproject.h>
+
+#include <project/projectmodel.h>
+
+#include <KConfigGroup>
+
+#include <QThread>
+
+CatkinBuildManager::CatkinBuildManager(CatkinManager* manager)
+ : m_manager(manager)
+{
+}
+
+KJob* CatkinBuildManager::build(KDevelop::ProjectBaseItem* item)
+{
+	return createJob(item, CatkinBuildJob::Build);
+}
+
+KJob* CatkinBuildManager::clean(KDevelop::ProjectBaseItem* item)
+{
+	return createJob(item, CatkinBuildJob::Clean);
+}
+
+KJob* CatkinBuildManager::install(KDevelop::ProjectBaseItem* item, const QUrl& specificPrefix)
+{
+	CatkinBuildJob* job = createJob(item, CatkinBuildJob::Install);
+	if(job && !specificPrefix.isEmpty())
+		job->setInstallPrefix(KDevelop::Path(specificPrefix));
+
+	return job;
+}
+
+KJob* CatkinBuildManager::dryRun(KDevelop::ProjectBaseItem* item)
+{
+	CatkinBuildJob* job = createJob(item, CatkinBuildJob::Build);
+	if(job)
+		job->setDryRun(true);
+
+	return job;
+}
+
+KJob* CatkinBuildManager::test(KDevelop::ProjectBaseItem* item, bool affectedOnly)
+{
+	KDevelop::IProject* workspace;
+	QList<CatkinSubProject*> packages;
+	if(!selectPackages(item, &workspace, &packages))
+		return nullptr;
+
+	KConfigGroup group(workspace->projectConfiguration(), "Catkin");
+
+	auto job = new CatkinTestJob(m_manager, workspace);
+	job->setPackages(packages);
+	job->setAffectedOnly(affectedOnly);
+	job->setMaximumConcurrency(group.readEntry("Parallel Tests", QThread::idealThreadCount()));
+
+	return job;
+}
+
+bool CatkinBuildManager::selectPackages(KDevelop::ProjectBaseItem* item, KDevelop::IProject** workspace, QList<CatkinSubProject*>* packages)
+{
+	*workspace = item->project();
+	if(auto subProject = qobject_cast<CatkinSubProject*>(*workspace))
+		*workspace = subProject->workspace();
+
+	if(!*workspace)
+		return false;
+
+	// An item inside a package selects that package, anything above
+	// all packages below it.
+	if(auto subProject = m_manager->subprojectForPath(item->path()))
+	{
+		*packages << subProject;
+		return true;
+	}
+
+	for(auto subProject : m_manager->subprojects(*workspace))
+	{
+		if(item->path() == subProject->path() || item->path().isParentOf(subProject->path()))
+			*packages << subProject;
+	}
+
+	return !packages->isEmpty();
+}
+
+CatkinBuildJob* CatkinBuildManager::createJob(KDevelop::ProjectBaseItem* item, CatkinBuildJob::Command command)
+{
+	KDevelop::IProject* workspace;
+	QList<CatkinSubProject*> packages;
+	if(!selectPackages(item, &workspace, &packages))
+		return nullptr;
+
+	KConfigGroup group(workspace->projectConfiguration(), "Catkin");
+
+	auto job = new CatkinBuildJob(m_manager, workspace, command);
+	job->setPackages(packages);
+	job->setMaximumConcurrency(group.readEntry("Parallel Builds", qMax(1, QThread::idealThreadCount() / 2)));
+	job->setJobs(group.readEntry("Build Jobs", QThread::idealThreadCount()));
+	job->setOnlyChanged(group.readEntry("Minimal Rebuild", true));
+
+	return job;
+}
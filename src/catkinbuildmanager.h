@@ -6,18 +6,31 @@
 
 #include <project/interfaces/iprojectbuilder.h>
 
+#include "catkinbuildjob.h"
+
+class CatkinManager;
+
 class CatkinBuildManager : public KDevelop::IProjectBuilder
 {
 public:
-	virtual KJob* build(KDevelop::ProjectBaseItem *item) override
-	{ return 0; }
+	explicit CatkinBuildManager(CatkinManager* manager);
+
+	virtual KJob* build(KDevelop::ProjectBaseItem *item) override;
+	virtual KJob* clean(KDevelop::ProjectBaseItem *item) override;
+	virtual KJob* install(KDevelop::ProjectBaseItem* item, const QUrl &specificPrefix = {}) override;
 
-	virtual KJob* clean(KDevelop::ProjectBaseItem *item) override
-	{ return 0; }
+	//! Lists the packages build() would build for @p item, and why
+	KJob* dryRun(KDevelop::ProjectBaseItem* item);
 
-	virtual KJob* install(KDevelop::ProjectBaseItem* item, const QUrl &specificPrefix = {}) override
-	{ return 0; }
+	//! Runs the tests of the packages selected by @p item, see CatkinTestJob
+	KJob* test(KDevelop::ProjectBaseItem* item, bool affectedOnly = false);
+private:
+	//! Workspace and packages affected by @p item, false if there are none
+	bool selectPackages(KDevelop::ProjectBaseItem* item, KDevelop::IProject** workspace, QList<CatkinSubProject*>* packages);
+
+	CatkinBuildJob* createJob(KDevelop::ProjectBaseItem* item, CatkinBuildJob::Command command);
+
+	CatkinManager* m_manager;
 };
 
 #endif
-
@@ -0,0 +1,355 @@
+// Output model for catkin builds, parses compiler diagnostics on the fly
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbuildoutputmodel.h"
+
+#include <outputview/filtereditem.h>
+#include <outputview/outputmodel.h>
+
+#include <interfaces/icore.h>
+#include <interfaces/idocumentcontroller.h>
+#include <interfaces/iproject.h>
+
+#include <project/projectmodel.h>
+
+#include <serialization/indexedstring.h>
+
+#include <KLocalizedString>
+#include <KTextEditor/Cursor>
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+using KDevelop::FilteredItem;
+
+namespace
+{
+	struct Marker
+	{
+		const char* text;
+		FilteredItem::FilteredOutputItemType type;
+	};
+
+	// Checked in this order, "fatal error" has to come before "error"
+	const Marker DIAGNOSTIC_MARKERS[] = {
+		{": fatal error: ", FilteredItem::ErrorItem},
+		{": error: ", FilteredItem::ErrorItem},
+		{": warning: ", FilteredItem::WarningItem},
+		{": note: ", FilteredItem::InformationItem},
+	};
+
+	// Continuation of "In file included from ", aligned below its "from"
+	const char GCC_INCLUDED_FROM[] = "                 from ";
+
+	//! Splits "file:line[:column]", line and column are returned 0-based
+	bool parseLocation(const QByteArray& location, QByteArray* file, int* line, int* column)
+	{
+		int last = location.lastIndexOf(':');
+		if(last <= 0)
+			return false;
+
+		bool ok;
+		int lastNumber = location.mid(last + 1).toInt(&ok);
+		if(!ok)
+			return false;
+
+		int previous = location.lastIndexOf(':', last - 1);
+		if(previous > 0)
+		{
+			int previousNumber = location.mid(previous + 1, last - previous - 1).toInt(&ok);
+			if(ok)
+			{
+				*file = location.left(previous);
+				*line = previousNumber - 1;
+				*column = lastNumber - 1;
+				return true;
+			}
+		}
+
+		*file = location.left(last);
+		*line = lastNumber - 1;
+		*column = 0;
+		return true;
+	}
+}
+
+CatkinBuildOutputModel::CatkinBuildOutputModel(KDevelop::IProject* workspace, QObject* parent)
+ : QAbstractListModel(parent)
+ , m_workspace(workspace)
+{
+	m_flushTimer.setSingleShot(true);
+	m_flushTimer.setInterval(50);
+	connect(&m_flushTimer, &QTimer::timeout, this, &CatkinBuildOutputModel::flush);
+}
+
+CatkinBuildOutputModel::~CatkinBuildOutputModel()
+{
+}
+
+void CatkinBuildOutputModel::startPackage(const QString& package, const KDevelop::Path& buildDirectory, const KDevelop::Path& sourceDirectory)
+{
+	Package& state = m_packages[package];
+	state.directory = buildDirectory;
+	state.sourceDirectory = sourceDirectory;
+
+	const QString realPath = QFileInfo(sourceDirectory.toLocalFile()).canonicalFilePath();
+	if(!realPath.isEmpty() && KDevelop::Path(realPath) != sourceDirectory)
+		state.realSourceDirectory = KDevelop::Path(realPath);
+}
+
+void CatkinBuildOutputModel::appendOutput(const QString& package, const QByteArray& data)
+{
+	Package& state = m_packages[package];
+
+	int start = 0;
+	int end;
+	while((end = data.indexOf('\n', start)) >= 0)
+	{
+		if(state.partial.isEmpty())
+			parseLine(package, &state, data.mid(start, end - start));
+		else
+		{
+			state.partial += data.mid(start, end - start);
+			parseLine(package, &state, state.partial);
+			state.partial.clear();
+		}
+
+		start = end + 1;
+	}
+
+	state.partial += data.mid(start);
+}
+
+void CatkinBuildOutputModel::appendLine(const QString& package, const QString& line)
+{
+	Line status;
+	status.text = QStringLiteral("[%1] %2").arg(package, line);
+	status.type = FilteredItem::StandardItem;
+	addLine(status);
+}
+
+void CatkinBuildOutputModel::endOutput(const QString& package)
+{
+	auto it = m_packages.find(package);
+	if(it == m_packages.end() || it->partial.isEmpty())
+		return;
+
+	parseLine(package, &*it, it->partial);
+	it->partial.clear();
+}
+
+void CatkinBuildOutputModel::finishPackage(const QString& package)
+{
+	endOutput(package);
+
+	auto it = m_packages.find(package);
+	if(it == m_packages.end())
+		return;
+
+	if(it->errors || it->warnings)
+	{
+		Line summary;
+		summary.text = QStringLiteral("[%1] %2").arg(package, i18n("%1 errors, %2 warnings", it->errors, it->warnings));
+		summary.type = it->errors ? FilteredItem::ErrorItem : FilteredItem::WarningItem;
+		addLine(summary);
+	}
+
+	m_packages.erase(it);
+}
+
+void CatkinBuildOutputModel::parseLine(const QString& package, Package* state, const QByteArray& raw)
+{
+	QByteArray text = raw;
+	if(text.endsWith('\r'))
+		text.chop(1);
+
+	Line line;
+	line.type = FilteredItem::StandardItem;
+
+	QByteArray location;
+
+	for(const Marker& marker : DIAGNOSTIC_MARKERS)
+	{
+		int idx = text.indexOf(marker.text);
+		if(idx > 0)
+		{
+			line.type = marker.type;
+			location = text.left(idx);
+			break;
+		}
+	}
+
+	if(line.type == FilteredItem::StandardItem)
+	{
+		QByteArray trimmed = text.trimmed();
+
+		if(trimmed.startsWith("CMake Error at ") || trimmed.startsWith("CMake Warning"))
+		{
+			// CMake Error at CMakeLists.txt:12 (find_package):
+			line.type = trimmed.startsWith("CMake Error") ? FilteredItem::ErrorItem : FilteredItem::WarningItem;
+
+			int at = trimmed.indexOf(" at ");
+			int paren = trimmed.indexOf(" (", at);
+			if(at > 0 && paren > at)
+				location = trimmed.mid(at + 4, paren - at - 4);
+		}
+		else if(trimmed.startsWith("In file included from ") || text.startsWith(GCC_INCLUDED_FROM))
+		{
+			line.type = FilteredItem::InformationItem;
+			location = trimmed.mid(trimmed.indexOf("from ") + 5);
+			if(location.endsWith(',') || location.endsWith(':'))
+				location.chop(1);
+		}
+		else if(trimmed.startsWith("FAILED: ") || (trimmed.contains("***") && trimmed.contains("make")))
+			line.type = FilteredItem::ErrorItem;
+	}
+
+	if(line.type == FilteredItem::ErrorItem)
+		state->errors++;
+	else if(line.type == FilteredItem::WarningItem)
+		state->warnings++;
+
+	QByteArray fileName;
+	if(!location.isEmpty() && parseLocation(location, &fileName, &line.line, &line.column))
+		line.file = resolve(*state, fileName);
+
+	line.text = QStringLiteral("[%1] %2").arg(package, QString::fromLocal8Bit(text));
+	addLine(line);
+}
+
+KDevelop::Path CatkinBuildOutputModel::resolve(const Package& state, const QByteArray& fileName) const
+{
+	QString name = QFile::decodeName(fileName);
+
+	const KDevelop::Path path = name.startsWith(QLatin1Char('/'))
+		? KDevelop::Path(name) : KDevelop::Path(state.directory, name);
+
+	auto items = m_workspace->filesForPath(KDevelop::IndexedString(path.pathOrUrl()));
+	if(!items.isEmpty())
+		return items.first()->path();
+
+	// Diagnostics of any package may point into this one (e.g. headers)
+	for(const Package& package : m_packages)
+	{
+		if(!package.realSourceDirectory.isValid() || !package.realSourceDirectory.isParentOf(path))
+			continue;
+
+		const KDevelop::Path mapped(package.sourceDirectory, package.realSourceDirectory.relativePath(path));
+		items = m_workspace->filesForPath(KDevelop::IndexedString(mapped.pathOrUrl()));
+		if(!items.isEmpty())
+			return items.first()->path();
+	}
+
+	return path;
+}
+
+void CatkinBuildOutputModel::addLine(const Line& line)
+{
+	m_pending << line;
+
+	if(!m_flushTimer.isActive())
+		m_flushTimer.start();
+}
+
+void CatkinBuildOutputModel::flush()
+{
+	if(m_pending.isEmpty())
+		return;
+
+	beginInsertRows(QModelIndex(), m_lines.size(), m_lines.size() + m_pending.size() - 1);
+
+	for(const Line& line : m_pending)
+	{
+		if(line.file.isValid() && (line.type == FilteredItem::ErrorItem || line.type == FilteredItem::WarningItem))
+			m_highlights << m_lines.size();
+
+		m_lines << line;
+	}
+	m_pending.clear();
+
+	endInsertRows();
+}
+
+int CatkinBuildOutputModel::rowCount(const QModelIndex& parent) const
+{
+	if(parent.isValid())
+		return 0;
+
+	return m_lines.size();
+}
+
+QVariant CatkinBuildOutputModel::data(const QModelIndex& index, int role) const
+{
+	if(!index.isValid() || index.row() >= m_lines.size())
+		return QVariant();
+
+	const Line& line = m_lines[index.row()];
+
+	switch(role)
+	{
+		case Qt::DisplayRole:
+			return line.text;
+		case KDevelop::OutputModel::OutputItemTypeRole:
+			return static_cast<int>(line.type);
+		case Qt::ToolTipRole:
+			if(line.file.isValid())
+				return line.file.pathOrUrl();
+			break;
+	}
+
+	return QVariant();
+}
+
+void CatkinBuildOutputModel::activate(const QModelIndex& index)
+{
+	if(!index.isValid() || index.row() >= m_lines.size())
+		return;
+
+	const Line& line = m_lines[index.row()];
+	if(!line.file.isValid())
+		return;
+
+	KDevelop::ICore::self()->documentController()->openDocument(
+		line.file.toUrl(), KTextEditor::Cursor(line.line, line.column)
+	);
+}
+
+QModelIndex CatkinBuildOutputModel::firstHighlightIndex()
+{
+	if(m_highlights.isEmpty())
+		return QModelIndex();
+
+	return index(m_highlights.first());
+}
+
+QModelIndex CatkinBuildOutputModel::lastHighlightIndex()
+{
+	if(m_highlights.isEmpty())
+		return QModelIndex();
+
+	return index(m_highlights.last());
+}
+
+QModelIndex CatkinBuildOutputModel::nextHighlightIndex(const QModelIndex& currentIndex)
+{
+	int row = currentIndex.isValid() ? currentIndex.row() : -1;
+
+	auto it = std::upper_bound(m_highlights.constBegin(), m_highlights.constEnd(), row);
+	if(it == m_highlights.constEnd())
+		return firstHighlightIndex();
+
+	return index(*it);
+}
+
+QModelIndex CatkinBuildOutputModel::previousHighlightIndex(const QModelIndex& currentIndex)
+{
+	int row = currentIndex.isValid() ? currentIndex.row() : m_lines.size();
+
+	auto it = std::lower_bound(m_highlights.constBegin(), m_highlights.constEnd(), row);
+	if(it == m_highlights.constBegin())
+		return lastHighlightIndex();
+
+	return index(*(it - 1));
+}
@@ -0,0 +1,110 @@
+// Output model for catkin builds, parses compiler diagnostics on the fly
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINBUILDOUTPUTMODEL_H
+#define CATKINBUILDOUTPUTMODEL_H
+
+#include <outputview/ioutputviewmodel.h>
+
+#include <util/path.h>
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QTimer>
+#include <QVector>
+
+namespace KDevelop
+{
+	class IProject;
+}
+
+/**
+ * Collects the output of the parallel package builds.
+ *
+ * Every package has its own line buffer, so lines of different packages
+ * never get mixed up, and each line is tagged with its package. Lines are
+ * checked for GCC/Clang/CMake diagnostics with a few substring searches on
+ * the raw bytes, which is cheap enough for the output of a large parallel
+ * build. Rows are inserted in batches.
+ *
+ * Diagnostics point to the file items of the workspace and can be activated
+ * to jump to the location. CMake hands the real paths of symlinked source
+ * directories to the compiler, those are mapped back into the workspace.
+ **/
+class CatkinBuildOutputModel : public QAbstractListModel, public KDevelop::IOutputViewModel
+{
+Q_OBJECT
+Q_INTERFACES(KDevelop::IOutputViewModel)
+public:
+	explicit CatkinBuildOutputModel(KDevelop::IProject* workspace, QObject* parent = nullptr);
+	~CatkinBuildOutputModel() override;
+
+	/**
+	 * Relative paths in the output of @p package are resolved against
+	 * @p buildDirectory, files below the real path of @p sourceDirectory
+	 * are mapped to @p sourceDirectory.
+	 **/
+	void startPackage(const QString& package, const KDevelop::Path& buildDirectory, const KDevelop::Path& sourceDirectory);
+
+	//! Raw process output of @p package, may end in the middle of a line
+	void appendOutput(const QString& package, const QByteArray& data);
+
+	//! A complete line not coming from a process
+	void appendLine(const QString& package, const QString& line);
+
+	//! The process writing the output of @p package exited, flushes the partial line
+	void endOutput(const QString& package);
+
+	//! Reports the diagnostic counts of @p package
+	void finishPackage(const QString& package);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+	void activate(const QModelIndex& index) override;
+	QModelIndex firstHighlightIndex() override;
+	QModelIndex nextHighlightIndex(const QModelIndex& currentIndex) override;
+	QModelIndex previousHighlightIndex(const QModelIndex& currentIndex) override;
+	QModelIndex lastHighlightIndex() override;
+private:
+	struct Line
+	{
+		QString text;
+		int type;
+		KDevelop::Path file;
+		int line = -1;
+		int column = -1;
+	};
+
+	struct Package
+	{
+		KDevelop::Path directory;
+		KDevelop::Path sourceDirectory;
+
+		//! Canonical path of sourceDirectory, if it differs
+		KDevelop::Path realSourceDirectory;
+
+		QByteArray partial;
+		int errors = 0;
+		int warnings = 0;
+	};
+
+	void parseLine(const QString& package, Package* state, const QByteArray& raw);
+	KDevelop::Path resolve(const Package& state, const QByteArray& fileName) const;
+	void addLine(const Line& line);
+	void flush();
+
+	KDevelop::IProject* m_workspace;
+
+	QHash<QString, Package> m_packages;
+
+	QVector<Line> m_lines;
+	QVector<Line> m_pending;
+
+	//! Rows of errors and warnings with a location, ascending
+	QVector<int> m_highlights;
+
+	QTimer m_flushTimer;
+};
+
+#endif
@@ -0,0 +1,136 @@
+// Reader for the CMakeCache.txt files of the package build directories
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkincmakecache.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+
+#include <string.h>
+
+namespace
+{
+	// Everything else in the cache file is skipped
+	const char* const INTERESTING_KEYS[] = {
+		"CATKIN_TEST_RESULTS_DIR",
+		"CMAKE_BUILD_TYPE",
+		"CMAKE_CACHEFILE_DIR",
+		"CMAKE_CXX_COMPILER",
+		"CMAKE_C_COMPILER",
+		"CMAKE_GENERATOR",
+		"CMAKE_HOME_DIRECTORY",
+		"CMAKE_INSTALL_PREFIX",
+	};
+
+	bool isInteresting(const char* key, int length)
+	{
+		for(const char* interesting : INTERESTING_KEYS)
+		{
+			if(strlen(interesting) == (size_t)length && memcmp(interesting, key, length) == 0)
+				return true;
+		}
+		return false;
+	}
+}
+
+QString CatkinCMakeCache::value(const KDevelop::Path& buildDirectory, const QByteArray& key)
+{
+	QMutexLocker lock(&m_mutex);
+	return entry(buildDirectory).values.value(key);
+}
+
+bool CatkinCMakeCache::usesMakefiles(const KDevelop::Path& buildDirectory)
+{
+	return value(buildDirectory, "CMAKE_GENERATOR") == QLatin1String("Unix Makefiles");
+}
+
+KDevelop::Path CatkinCMakeCache::compiler(const KDevelop::Path& buildDirectory)
+{
+	QMutexLocker lock(&m_mutex);
+	return entry(buildDirectory).compiler;
+}
+
+void CatkinCMakeCache::invalidate(const KDevelop::Path& buildDirectory)
+{
+	QMutexLocker lock(&m_mutex);
+	m_entries.remove(buildDirectory);
+}
+
+const CatkinCMakeCache::Entry& CatkinCMakeCache::entry(const KDevelop::Path& buildDirectory)
+{
+	Entry& entry = m_entries[buildDirectory];
+
+	KDevelop::Path cacheFile(buildDirectory, "CMakeCache.txt");
+	QFileInfo info(cacheFile.toLocalFile());
+	qint64 mtime = info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1;
+
+	if(mtime != entry.mtime)
+	{
+		entry = Entry();
+		entry.mtime = mtime;
+
+		if(mtime >= 0)
+			read(cacheFile.toLocalFile(), &entry);
+	}
+
+	return entry;
+}
+
+void CatkinCMakeCache::read(const QString& fileName, Entry* entry)
+{
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly) || file.size() == 0)
+		return;
+
+	const uchar* data = file.map(0, file.size());
+	if(!data)
+		return;
+
+	const char* pos = reinterpret_cast<const char*>(data);
+	const char* end = pos + file.size();
+
+	// Lines look like KEY:TYPE=VALUE, comments start with // or #
+	while(pos < end)
+	{
+		const char* lineEnd = static_cast<const char*>(memchr(pos, '\n', end - pos));
+		if(!lineEnd)
+			lineEnd = end;
+
+		const char* line = pos;
+		pos = lineEnd + 1;
+
+		if(line == lineEnd || *line == '#' || *line == '/')
+			continue;
+
+		const char* colon = static_cast<const char*>(memchr(line, ':', lineEnd - line));
+		if(!colon || !isInteresting(line, colon - line))
+			continue;
+
+		const char* equals = static_cast<const char*>(memchr(colon, '=', lineEnd - colon));
+		if(!equals)
+			continue;
+
+		const char* valueEnd = lineEnd;
+		if(valueEnd > equals + 1 && valueEnd[-1] == '\r')
+			--valueEnd;
+
+		entry->values.insert(
+			QByteArray(line, colon - line),
+			QString::fromLocal8Bit(equals + 1, valueEnd - equals - 1)
+		);
+	}
+
+	QString compiler = entry->values.value("CMAKE_CXX_COMPILER");
+	if(compiler.isEmpty())
+		compiler = entry->values.value("CMAKE_C_COMPILER");
+
+	if(compiler.isEmpty())
+		return;
+
+	auto it = m_compilers.constFind(compiler);
+	if(it == m_compilers.constEnd())
+		it = m_compilers.insert(compiler, KDevelop::Path(compiler));
+
+	entry->compiler = *it;
+}
@@ -0,0 +1,53 @@
+// Reader for the CMakeCache.txt files of the package build directories
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINCMAKECACHE_H
+#define CATKINCMAKECACHE_H
+
+#include <util/path.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/**
+ * The few CMakeCache.txt variables we are interested in, per build directory.
+ *
+ * A cache file is scanned once and re-read only if its mtime changes.
+ * Compiler paths are interned, so all packages configured with the same
+ * compiler return the same Path and KDevelop probes it only once.
+ *
+ * Thread-safe, the answers are requested from parse jobs.
+ **/
+class CatkinCMakeCache
+{
+public:
+	//! Value of the cache variable @p key (see the list in the .cpp)
+	QString value(const KDevelop::Path& buildDirectory, const QByteArray& key);
+
+	//! Whether @p buildDirectory is configured with the Makefile generator
+	bool usesMakefiles(const KDevelop::Path& buildDirectory);
+
+	//! The C++ compiler of @p buildDirectory, empty if not configured yet
+	KDevelop::Path compiler(const KDevelop::Path& buildDirectory);
+
+	//! Drops everything cached for @p buildDirectory
+	void invalidate(const KDevelop::Path& buildDirectory);
+private:
+	struct Entry
+	{
+		qint64 mtime = -1;
+		QHash<QByteArray, QString> values;
+		KDevelop::Path compiler;
+	};
+
+	const Entry& entry(const KDevelop::Path& buildDirectory);
+	void read(const QString& fileName, Entry* entry);
+
+	QMutex m_mutex;
+	QHash<KDevelop::Path, Entry> m_entries;
+	QHash<QString, KDevelop::Path> m_compilers;
+};
+
+#endif
@@ -0,0 +1,409 @@
+// Reader for compile_commands.json files in the package build directories
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkincompiledatabase.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+
+#include <string.h>
+
+namespace
+{
+
+/**
+ * Just enough JSON to read a compilation database. Strings without
+ * escape sequences (the common case) are copied in one go.
+ **/
+class JsonScanner
+{
+public:
+	JsonScanner(const char* begin, const char* end)
+	 : m_pos(begin)
+	 , m_end(end)
+	{}
+
+	bool consume(char c)
+	{
+		skipWhitespace();
+		if(m_pos < m_end && *m_pos == c)
+		{
+			++m_pos;
+			return true;
+		}
+		return false;
+	}
+
+	bool readString(QByteArray* out)
+	{
+		if(!consume('"'))
+			return false;
+
+		const char* start = m_pos;
+		while(m_pos < m_end && *m_pos != '"' && *m_pos != '\\')
+			++m_pos;
+
+		if(m_pos >= m_end)
+			return false;
+
+		if(*m_pos == '"')
+		{
+			if(out)
+				*out = QByteArray(start, m_pos - start);
+			++m_pos;
+			return true;
+		}
+
+		QByteArray str(start, m_pos - start);
+		while(m_pos < m_end && *m_pos != '"')
+		{
+			if(*m_pos != '\\')
+			{
+				str += *m_pos++;
+				continue;
+			}
+
+			if(++m_pos >= m_end)
+				return false;
+
+			switch(*m_pos)
+			{
+				case 'n': str += '\n'; break;
+				case 't': str += '\t'; break;
+				case 'r': str += '\r'; break;
+				case 'b': str += '\b'; break;
+				case 'f': str += '\f'; break;
+				case 'u':
+				{
+					if(m_end - m_pos < 5)
+						return false;
+					ushort code = QByteArray(m_pos + 1, 4).toUShort(nullptr, 16);
+					str += QString(QChar(code)).toUtf8();
+					m_pos += 4;
+					break;
+				}
+				default: // \" \\ \/
+					str += *m_pos;
+					break;
+			}
+			++m_pos;
+		}
+
+		if(m_pos >= m_end)
+			return false;
+
+		++m_pos;
+		if(out)
+			*out = str;
+		return true;
+	}
+
+	bool skipValue()
+	{
+		skipWhitespace();
+		if(m_pos >= m_end)
+			return false;
+
+		if(*m_pos == '"')
+			return readString(nullptr);
+
+		if(*m_pos == '[' || *m_pos == '{')
+		{
+			int depth = 0;
+			while(m_pos < m_end)
+			{
+				char c = *m_pos;
+				if(c == '"')
+				{
+					if(!readString(nullptr))
+						return false;
+					continue;
+				}
+
+				++m_pos;
+				if(c == '[' || c == '{')
+					depth++;
+				else if((c == ']' || c == '}') && --depth == 0)
+					return true;
+			}
+			return false;
+		}
+
+		// numbers, true, false, null
+		while(m_pos < m_end && !strchr(",]} \t\r\n", *m_pos))
+			++m_pos;
+		return true;
+	}
+private:
+	void skipWhitespace()
+	{
+		while(m_pos < m_end && (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t'))
+			++m_pos;
+	}
+
+	const char* m_pos;
+	const char* const m_end;
+};
+
+QList<QByteArray> splitCommand(const QByteArray& command)
+{
+	QList<QByteArray> args;
+	QByteArray current;
+	bool inArg = false;
+	char quote = 0;
+
+	for(int i = 0; i < command.size(); ++i)
+	{
+		char c = command[i];
+
+		if(quote)
+		{
+			if(c == quote)
+				quote = 0;
+			else if(c == '\\' && quote == '"' && i+1 < command.size())
+				current += command[++i];
+			else
+				current += c;
+		}
+		else if(c == '"' || c == '\'')
+		{
+			quote = c;
+			inArg = true;
+		}
+		else if(c == '\\' && i+1 < command.size())
+		{
+			current += command[++i];
+			inArg = true;
+		}
+		else if(c == ' ' || c == '\t' || c == '\n')
+		{
+			if(inArg)
+			{
+				args << current;
+				current.clear();
+				inArg = false;
+			}
+		}
+		else
+		{
+			current += c;
+			inArg = true;
+		}
+	}
+
+	if(inArg)
+		args << current;
+
+	return args;
+}
+
+KDevelop::Path resolve(const QString& directory, const QString& path)
+{
+	if(QDir::isAbsolutePath(path))
+		return KDevelop::Path(path);
+
+	return KDevelop::Path(KDevelop::Path(directory), path);
+}
+
+//! Options naming output files, their value is in the next argument
+bool isOutputOption(const QByteArray& arg)
+{
+	return arg == "-o" || arg == "-MF" || arg == "-MT" || arg == "-MQ";
+}
+
+CatkinBuildInfo parseArguments(const QString& directory, const QList<QByteArray>& args)
+{
+	CatkinBuildInfo info;
+	QStringList extra;
+
+	// args[0] is the compiler
+	for(int i = 1; i < args.size(); ++i)
+	{
+		const QByteArray& arg = args[i];
+
+		auto value = [&](int prefixLength) -> QString {
+			if(arg.size() > prefixLength)
+				return QString::fromLocal8Bit(arg.mid(prefixLength));
+			if(i+1 < args.size())
+				return QString::fromLocal8Bit(args[++i]);
+			return QString();
+		};
+
+		if(arg.startsWith("-I"))
+			info.includeDirectories << resolve(directory, value(2));
+		else if(arg.startsWith("-isystem"))
+			info.includeDirectories << resolve(directory, value(8));
+		else if(arg.startsWith("-iquote"))
+			info.includeDirectories << resolve(directory, value(7));
+		else if(arg.startsWith("-idirafter"))
+			info.includeDirectories << resolve(directory, value(10));
+		else if(arg.startsWith("-F"))
+			info.frameworkDirectories << resolve(directory, value(2));
+		else if(arg.startsWith("-D"))
+		{
+			QString define = value(2);
+			int eq = define.indexOf('=');
+			if(eq < 0)
+				info.defines.insert(define, QString());
+			else
+				info.defines.insert(define.left(eq), define.mid(eq+1));
+		}
+		else if(isOutputOption(arg))
+			++i; // skip the file name
+		else if(arg.startsWith("-std=") || arg == "-pthread"
+			|| (arg.startsWith("-W") && !arg.startsWith("-Wl,") && !arg.startsWith("-Wa,") && !arg.startsWith("-Wp,"))
+			|| (arg.startsWith("-f") && arg.size() > 2)
+			|| (arg.startsWith("-m") && arg.size() > 2))
+		{
+			extra << QString::fromLocal8Bit(arg);
+		}
+	}
+
+	info.extraArguments = extra.join(QLatin1Char(' '));
+	return info;
+}
+
+}
+
+bool CatkinCompileDatabase::load(const QString& fileName, CatkinBuildInfoCache* cache)
+{
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly) || file.size() == 0)
+		return false;
+
+	const uchar* data = file.map(0, file.size());
+	if(!data)
+		return false;
+
+	const char* begin = reinterpret_cast<const char*>(data);
+	JsonScanner json(begin, begin + file.size());
+
+	// Files compiled with the same flags share one entry
+	QHash<QByteArray, int> flagSets;
+
+	auto addEntry = [&](const QByteArray& directory, const QByteArray& fileName, QList<QByteArray> args){
+		if(args.isEmpty() || fileName.isEmpty())
+			return;
+
+		QString dir = QFile::decodeName(directory);
+		KDevelop::Path filePath = resolve(dir, QFile::decodeName(fileName));
+
+		// The flag set is everything except the source file itself and
+		// the output files, which differ for every file
+		QByteArray signature = directory;
+		for(int i = 0; i < args.size(); ++i)
+		{
+			if(args[i] == fileName)
+				continue;
+			if(isOutputOption(args[i]))
+			{
+				++i;
+				continue;
+			}
+			signature += '\0';
+			signature += args[i];
+		}
+
+		int index = flagSets.value(signature, -1);
+		if(index < 0)
+		{
+			CatkinBuildInfo info = parseArguments(dir, args);
+			if(cache)
+				info = cache->intern(info);
+
+			index = m_infos.size();
+			m_infos << info;
+			flagSets.insert(signature, index);
+		}
+
+		m_files.insert(filePath.toLocalFile(), index);
+		if(!m_directories.contains(filePath.parent().toLocalFile()))
+			m_directories.insert(filePath.parent().toLocalFile(), index);
+	};
+
+	bool ok = [&](){
+		if(!json.consume('['))
+			return false;
+
+		if(json.consume(']'))
+			return true;
+
+		do
+		{
+			if(!json.consume('{'))
+				return false;
+
+			QByteArray directory;
+			QByteArray fileName;
+			QByteArray command;
+			QList<QByteArray> arguments;
+
+			if(!json.consume('}'))
+			{
+				do
+				{
+					QByteArray key;
+					if(!json.readString(&key) || !json.consume(':'))
+						return false;
+
+					bool valid;
+					if(key == "directory")
+						valid = json.readString(&directory);
+					else if(key == "file")
+						valid = json.readString(&fileName);
+					else if(key == "command")
+						valid = json.readString(&command);
+					else if(key == "arguments")
+					{
+						valid = json.consume('[');
+						if(valid && !json.consume(']'))
+						{
+							do
+							{
+								QByteArray arg;
+								valid = json.readString(&arg);
+								arguments << arg;
+							}
+							while(valid && json.consume(','));
+
+							valid = valid && json.consume(']');
+						}
+					}
+					else
+						valid = json.skipValue();
+
+					if(!valid)
+						return false;
+				}
+				while(json.consume(','));
+
+				if(!json.consume('}'))
+					return false;
+			}
+
+			addEntry(directory, fileName, arguments.isEmpty() ? splitCommand(command) : arguments);
+		}
+		while(json.consume(','));
+
+		return json.consume(']');
+	}();
+
+	if(!ok)
+		qWarning() << "Could not parse compilation database" << fileName;
+
+	return ok;
+}
+
+bool CatkinCompileDatabase::buildInfo(const KDevelop::Path& file, CatkinBuildInfo* info) const
+{
+	if(m_infos.isEmpty())
+		return false;
+
+	int index = m_files.value(file.toLocalFile(), -1);
+	if(index < 0)
+		index = m_directories.value(file.parent().toLocalFile(), 0);
+
+	*info = m_infos[index];
+	return true;
+}
@@ -0,0 +1,49 @@
+// Reader for compile_commands.json files in the package build directories
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINCOMPILEDATABASE_H
+#define CATKINCOMPILEDATABASE_H
+
+#include "catkinbuildinfocache.h"
+
+#include <util/path.h>
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * Build information from the compile_commands.json of the last build.
+ *
+ * This allows us to answer build information queries long before the CMake
+ * import of a package has finished. The file is memory-mapped and scanned
+ * with a minimal JSON reader. Files compiled with identical flags (usually
+ * all files of a target) share one CatkinBuildInfo.
+ **/
+class CatkinCompileDatabase
+{
+public:
+	//! @p cache is used to intern the flag sets, may be nullptr
+	bool load(const QString& fileName, CatkinBuildInfoCache* cache = nullptr);
+
+	bool isEmpty() const
+	{ return m_infos.isEmpty(); }
+
+	//! Local paths of all files listed in the database
+	QStringList files() const
+	{ return m_files.keys(); }
+
+	/**
+	 * Build information for @p file. Files not contained in the database
+	 * (e.g. headers) get the flags of a file in the same directory, or
+	 * the first entry of the database.
+	 **/
+	bool buildInfo(const KDevelop::Path& file, CatkinBuildInfo* info) const;
+private:
+	QVector<CatkinBuildInfo> m_infos;
+	QHash<QString, int> m_files;
+	QHash<QString, int> m_directories;
+};
+
+#endif
@@ -0,0 +1,73 @@
+// Single configuration store for all sub-projects of a workspace
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinconfigstore.h"
+
+#include <KConfigGroup>
+
+namespace
+{
+	void copyGroup(const KConfigGroup& from, KConfigGroup to)
+	{
+		const auto entries = from.entryMap();
+		for(auto it = entries.begin(); it != entries.end(); ++it)
+			to.writeEntry(it.key(), it.value());
+
+		for(const auto& name : from.groupList())
+			copyGroup(from.group(name), to.group(name));
+	}
+
+	QString packageGroup(const QString& name)
+	{
+		return QStringLiteral("Package %1").arg(name);
+	}
+}
+
+CatkinConfigStore::CatkinConfigStore(const QString& fileName)
+ : m_config(KSharedConfig::openConfig(fileName, KConfig::SimpleConfig))
+{
+}
+
+CatkinConfigStore::~CatkinConfigStore()
+{
+	sync();
+}
+
+KSharedConfigPtr CatkinConfigStore::configuration(const QString& name)
+{
+	KSharedConfigPtr view = KSharedConfig::openConfig(
+		m_viewDir.filePath(name + QStringLiteral(".kdev4")), KConfig::SimpleConfig
+	);
+
+	KConfigGroup package(m_config, packageGroup(name));
+	for(const auto& group : package.groupList())
+		copyGroup(package.group(group), KConfigGroup(view, group));
+
+	KConfigGroup project(view, "Project");
+	if(!project.hasKey("Name"))
+	{
+		project.writeEntry("Name", name);
+		project.writeEntry("CreatedFrom", "CMakeLists.txt");
+		project.writeEntry("Manager", "KDevCMakeManager");
+	}
+
+	// Nothing to write yet, the data came from the store
+	view->markAsClean();
+
+	return view;
+}
+
+void CatkinConfigStore::store(const QString& name, const KSharedConfigPtr& config)
+{
+	KConfigGroup package(m_config, packageGroup(name));
+	for(const auto& group : config->groupList())
+		copyGroup(KConfigGroup(config, group), KConfigGroup(&package, group));
+
+	config->markAsClean();
+}
+
+void CatkinConfigStore::sync()
+{
+	// No-op if nothing was stored since the last sync
+	m_config->sync();
+}
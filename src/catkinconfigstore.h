@@ -0,0 +1,44 @@
+// Single configuration store for all sub-projects of a workspace
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINCONFIGSTORE_H
+#define CATKINCONFIGSTORE_H
+
+#include <KSharedConfig>
+
+#include <QString>
+#include <QTemporaryDir>
+
+/**
+ * Keeps the configuration of all sub-projects in one file per workspace,
+ * instead of one .kdev4 file (plus developer file) per package.
+ *
+ * Each sub-project gets a view of its part of the store, which is never
+ * written to disk itself. store() copies a view back, sync() writes all
+ * pending changes with a single sync of the store file.
+ **/
+class CatkinConfigStore
+{
+public:
+	explicit CatkinConfigStore(const QString& fileName);
+	~CatkinConfigStore();
+
+	CatkinConfigStore(const CatkinConfigStore&) = delete;
+	CatkinConfigStore& operator=(const CatkinConfigStore&) = delete;
+
+	//! Configuration view for the package @p name
+	KSharedConfigPtr configuration(const QString& name);
+
+	//! Copies the view @p config of package @p name back into the store
+	void store(const QString& name, const KSharedConfigPtr& config);
+
+	//! Writes all stored changes to disk
+	void sync();
+private:
+	KSharedConfigPtr m_config;
+
+	//! The views need a unique file name, but are never written there
+	QTemporaryDir m_viewDir;
+};
+
+#endif
@@ -0,0 +1,112 @@
+// Dependency graph between the packages of a catkin workspace
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkindependencygraph.h"
+#include "catkinmanifest.h"
+#include "catkinsubproject.h"
+
+QVector<CatkinDependencyGraph::Package> CatkinDependencyGraph::packages(const QList<CatkinSubProject*>& projects)
+{
+	QVector<Package> packages;
+	packages.reserve(projects.size());
+	for(auto project : projects)
+		packages << Package{project, project->path(), project->buildPath()};
+
+	return packages;
+}
+
+CatkinDependencyGraph::CatkinDependencyGraph(const QList<CatkinSubProject*>& projects)
+ : CatkinDependencyGraph(packages(projects))
+{
+}
+
+CatkinDependencyGraph::CatkinDependencyGraph(const QVector<Package>& packages)
+{
+	QVector<QString> manifestFiles;
+	manifestFiles.reserve(packages.size());
+	for(const Package& package : packages)
+		manifestFiles << KDevelop::Path(package.path, "package.xml").toLocalFile();
+
+	const QVector<CatkinManifest> manifests = CatkinManifest::readAll(manifestFiles);
+
+	for(int i = 0; i < packages.size(); ++i)
+	{
+		if(!manifests[i].name.isEmpty())
+			m_packages.insert(manifests[i].name, packages[i]);
+	}
+
+	for(const CatkinManifest& manifest : manifests)
+	{
+		if(manifest.name.isEmpty())
+			continue;
+
+		QStringList dependencies;
+		for(const QStringList& list : {manifest.buildDepends, manifest.buildExportDepends, manifest.buildtoolDepends, manifest.testDepends})
+		{
+			for(const QString& dependency : list)
+			{
+				if(dependency != manifest.name && m_packages.contains(dependency) && !dependencies.contains(dependency))
+					dependencies << dependency;
+			}
+		}
+
+		for(const QString& dependency : dependencies)
+			m_dependents[dependency] << manifest.name;
+
+		m_dependencies.insert(manifest.name, dependencies);
+	}
+}
+
+QSet<QString> CatkinDependencyGraph::dependencyClosure(const QStringList& names) const
+{
+	QSet<QString> result;
+	QStringList stack = names;
+	while(!stack.isEmpty())
+	{
+		QString name = stack.takeLast();
+		if(result.contains(name) || !m_packages.contains(name))
+			continue;
+
+		result.insert(name);
+		stack << m_dependencies.value(name);
+	}
+	return result;
+}
+
+QStringList CatkinDependencyGraph::cyclicPackages(const QSet<QString>& names) const
+{
+	// Peel off the packages whose dependencies are all peeled off,
+	// whatever remains cannot be ordered
+	QHash<QString, int> remaining;
+	QStringList ready;
+	for(const QString& name : names)
+	{
+		int count = 0;
+		for(const QString& dependency : m_dependencies.value(name))
+		{
+			if(names.contains(dependency))
+				count++;
+		}
+
+		remaining.insert(name, count);
+		if(count == 0)
+			ready << name;
+	}
+
+	while(!ready.isEmpty())
+	{
+		const QString name = ready.takeLast();
+		remaining.remove(name);
+
+		for(const QString& dependent : m_dependents.value(name))
+		{
+			auto it = remaining.find(dependent);
+			if(it != remaining.end() && --(*it) == 0)
+				ready << dependent;
+		}
+	}
+
+	QStringList cyclic = remaining.keys();
+	cyclic.sort();
+	return cyclic;
+}
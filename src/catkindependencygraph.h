@@ -0,0 +1,76 @@
+// Dependency graph between the packages of a catkin workspace
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINDEPENDENCYGRAPH_H
+#define CATKINDEPENDENCYGRAPH_H
+
+#include <util/path.h>
+
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+class CatkinSubProject;
+
+/**
+ * Build dependencies (build, build_export, buildtool and test depends)
+ * between the given packages, read from their package.xml files.
+ *
+ * Dependencies on packages outside of the graph are dropped, as are
+ * unknown package names passed to dependencyClosure().
+ *
+ * The graph can be built in a worker thread from packages(), the
+ * sub-projects themselves are only touched in the main thread.
+ **/
+class CatkinDependencyGraph
+{
+public:
+	struct Package
+	{
+		CatkinSubProject* project;
+		KDevelop::Path path;
+		KDevelop::Path buildPath;
+	};
+
+	//! What the graph needs to know about @p projects, call in the main thread
+	static QVector<Package> packages(const QList<CatkinSubProject*>& projects);
+
+	explicit CatkinDependencyGraph(const QVector<Package>& packages);
+	explicit CatkinDependencyGraph(const QList<CatkinSubProject*>& projects);
+
+	QStringList packageNames() const
+	{ return m_packages.keys(); }
+
+	CatkinSubProject* package(const QString& name) const
+	{ return m_packages.value(name).project; }
+
+	//! Source path of @p name, safe to use in any thread
+	KDevelop::Path path(const QString& name) const
+	{ return m_packages.value(name).path; }
+
+	//! Build path of @p name, safe to use in any thread
+	KDevelop::Path buildPath(const QString& name) const
+	{ return m_packages.value(name).buildPath; }
+
+	//! Direct dependencies of @p name
+	QStringList dependencies(const QString& name) const
+	{ return m_dependencies.value(name); }
+
+	//! Packages directly depending on @p name
+	QStringList dependents(const QString& name) const
+	{ return m_dependents.value(name); }
+
+	//! @p names and everything they depend on
+	QSet<QString> dependencyClosure(const QStringList& names) const;
+
+	//! Packages of @p names which are part of, or depend on, a dependency cycle within @p names
+	QStringList cyclicPackages(const QSet<QString>& names) const;
+private:
+	QHash<QString, Package> m_packages;
+	QHash<QString, QStringList> m_dependencies;
+	QHash<QString, QStringList> m_dependents;
+};
+
+#endif
@@ -0,0 +1,169 @@
+// Runs the CMake imports of the sub-projects with bounded concurrency
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinimportscheduler.h"
+
+#include <QDebug>
+#include <QThread>
+#include <QTimer>
+
+CatkinImportScheduler::CatkinImportScheduler(QObject* parent)
+ : KJob(parent)
+ , m_maxConcurrency(QThread::idealThreadCount())
+{
+	setCapabilities(KJob::Killable);
+}
+
+CatkinImportScheduler::~CatkinImportScheduler()
+{
+}
+
+void CatkinImportScheduler::setMaximumConcurrency(int jobs)
+{
+	m_maxConcurrency = qMax(1, jobs);
+}
+
+void CatkinImportScheduler::setTimeout(int msecs)
+{
+	m_timeout = msecs;
+}
+
+void CatkinImportScheduler::enqueue(KJob* job, const QString& name, bool urgent)
+{
+	Q_ASSERT(!m_inputComplete);
+
+	if(urgent)
+		m_queue.prepend({job, name, nullptr});
+	else
+		m_queue.enqueue({job, name, nullptr});
+	m_total++;
+	setTotalAmount(KJob::Items, m_total);
+	emitPercent(m_done, m_total);
+
+	if(m_started)
+		startJobs();
+}
+
+void CatkinImportScheduler::setInputComplete()
+{
+	m_inputComplete = true;
+
+	if(m_started)
+		checkDone();
+}
+
+void CatkinImportScheduler::start()
+{
+	m_started = true;
+	startJobs();
+	checkDone();
+}
+
+bool CatkinImportScheduler::doKill()
+{
+	QList<Entry> entries = m_queue;
+	entries += m_running.values();
+
+	m_queue.clear();
+	m_running.clear();
+
+	for(const auto& entry : entries)
+	{
+		disconnect(entry.job, &KJob::result, this, &CatkinImportScheduler::jobFinished);
+
+		if(entry.timer)
+			entry.timer->deleteLater();
+
+		// Queued jobs were never started, but their owners still want the result
+		if(!entry.job->kill())
+			qWarning() << "Import of" << entry.name << "cannot be cancelled, it continues in the background";
+	}
+
+	return true;
+}
+
+void CatkinImportScheduler::startJobs()
+{
+	while(m_running.size() < m_maxConcurrency && !m_queue.isEmpty())
+	{
+		Entry entry = m_queue.dequeue();
+
+		connect(entry.job, &KJob::result, this, &CatkinImportScheduler::jobFinished);
+
+		if(m_timeout > 0)
+		{
+			KJob* job = entry.job;
+			entry.timer = new QTimer(this);
+			entry.timer->setSingleShot(true);
+			connect(entry.timer, &QTimer::timeout, this, [this, job](){
+				jobTimedOut(job);
+			});
+			entry.timer->start(m_timeout);
+		}
+
+		m_running.insert(entry.job, entry);
+		entry.job->start();
+	}
+}
+
+void CatkinImportScheduler::jobFinished(KJob* job)
+{
+	auto it = m_running.find(job);
+	if(it == m_running.end())
+		return;
+
+	Entry entry = *it;
+	m_running.erase(it);
+
+	if(job->error())
+	{
+		qWarning() << "Import of" << entry.name << "failed:" << job->errorString();
+		m_failed << entry.name;
+	}
+
+	finishEntry(entry);
+}
+
+void CatkinImportScheduler::jobTimedOut(KJob* job)
+{
+	auto it = m_running.find(job);
+	if(it == m_running.end())
+		return;
+
+	Entry entry = *it;
+	m_running.erase(it);
+
+	qWarning() << "Import of" << entry.name << "timed out after" << m_timeout << "ms";
+	m_failed << entry.name;
+
+	// If the job cannot be killed it keeps running on its own,
+	// but it does not block a slot anymore.
+	disconnect(job, &KJob::result, this, &CatkinImportScheduler::jobFinished);
+	job->kill(KJob::Quietly);
+
+	finishEntry(entry);
+}
+
+void CatkinImportScheduler::finishEntry(const Entry& entry)
+{
+	if(entry.timer)
+		entry.timer->deleteLater();
+
+	m_done++;
+	setProcessedAmount(KJob::Items, m_done);
+	emitPercent(m_done, m_total);
+
+	startJobs();
+	checkDone();
+}
+
+void CatkinImportScheduler::checkDone()
+{
+	if(!m_inputComplete || !m_queue.isEmpty() || !m_running.isEmpty())
+		return;
+
+	if(!m_failed.isEmpty())
+		qWarning() << m_failed.size() << "of" << m_total << "imports failed:" << m_failed;
+
+	emitResult();
+}
@@ -0,0 +1,80 @@
+// Runs the CMake imports of the sub-projects with bounded concurrency
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINIMPORTSCHEDULER_H
+#define CATKINIMPORTSCHEDULER_H
+
+#include <KJob>
+
+#include <QHash>
+#include <QQueue>
+#include <QStringList>
+
+class QTimer;
+
+/**
+ * Keeps up to maximumConcurrency() jobs running at the same time.
+ *
+ * Jobs can be enqueued while the scheduler is running. The scheduler finishes
+ * once setInputComplete() has been called and all jobs are done. A failing or
+ * timed out job never aborts the others, it is only recorded in failedJobs().
+ *
+ * Killing the scheduler kills all queued and running jobs. Jobs that refuse
+ * to be killed are left running on their own.
+ **/
+class CatkinImportScheduler : public KJob
+{
+Q_OBJECT
+public:
+	explicit CatkinImportScheduler(QObject* parent = nullptr);
+	~CatkinImportScheduler() override;
+
+	void setMaximumConcurrency(int jobs);
+	int maximumConcurrency() const
+	{ return m_maxConcurrency; }
+
+	//! Timeout per job in ms, 0 disables the timeout
+	void setTimeout(int msecs);
+
+	//! @p urgent jobs are started before all jobs enqueued so far
+	void enqueue(KJob* job, const QString& name, bool urgent = false);
+
+	//! No more jobs will be enqueued
+	void setInputComplete();
+
+	void start() override;
+
+	QStringList failedJobs() const
+	{ return m_failed; }
+protected:
+	bool doKill() override;
+private:
+	struct Entry
+	{
+		KJob* job;
+		QString name;
+		QTimer* timer;
+	};
+
+	void startJobs();
+	void jobFinished(KJob* job);
+	void jobTimedOut(KJob* job);
+	void finishEntry(const Entry& entry);
+	void checkDone();
+
+	int m_maxConcurrency;
+	int m_timeout = 0;
+
+	bool m_started = false;
+	bool m_inputComplete = false;
+
+	QQueue<Entry> m_queue;
+	QHash<KJob*, Entry> m_running;
+
+	qulonglong m_total = 0;
+	qulonglong m_done = 0;
+
+	QStringList m_failed;
+};
+
+#endif
@@ -0,0 +1,181 @@
+// Command-line indexer, pre-computes the caches of the catkin plugin
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbuildinfocache.h"
+#include "catkincompiledatabase.h"
+#include "catkinpackageindex.h"
+#include "catkinsessionsnapshot.h"
+#include "catkintrace.h"
+#include "catkinworkspacecrawler.h"
+
+#include <util/path.h>
+
+#include <ThreadWeaver/ThreadWeaver>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+namespace
+{
+	struct PackageInfo
+	{
+		CatkinPackageIndex::Package package;
+		QHash<KDevelop::Path, CatkinBuildInfo> files;
+	};
+
+	KDevelop::Path absolutePath(const QString& path)
+	{
+		return KDevelop::Path(QFileInfo(path).absoluteFilePath());
+	}
+}
+
+/**
+ * Crawls a catkin source space and writes the package index and the
+ * session snapshot, exactly where and how the plugin reads them on open.
+ *
+ * The build information comes from the compile_commands.json files of the
+ * last build. The plugin still imports all packages with CMake, but starts
+ * with a complete package list and build information right away.
+ *
+ * The caches are written to <build space>/.kdevcatkin, the build space
+ * defaults to <source space>/../build, like in the plugin.
+ **/
+int main(int argc, char** argv)
+{
+	QCoreApplication app(argc, argv);
+	app.setApplicationName(QStringLiteral("kdevcatkin-indexer"));
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QStringLiteral("Pre-computes the workspace caches of the KDevelop catkin plugin"));
+	parser.addHelpOption();
+	parser.addPositionalArgument(QStringLiteral("src"), QStringLiteral("Source space of the catkin workspace"));
+
+	QCommandLineOption buildOption(QStringLiteral("build"),
+		QStringLiteral("Build space (default: <src>/../build)"), QStringLiteral("dir"));
+	QCommandLineOption outputOption(QStringLiteral("output"),
+		QStringLiteral("Output directory (default: <build>/.kdevcatkin)"), QStringLiteral("dir"));
+	parser.addOption(buildOption);
+	parser.addOption(outputOption);
+
+	parser.process(app);
+
+	if(parser.positionalArguments().size() != 1)
+		parser.showHelp(1);
+
+	KDevelop::Path sourceSpace = absolutePath(parser.positionalArguments().first());
+
+	KDevelop::Path buildSpace = parser.isSet(buildOption)
+		? absolutePath(parser.value(buildOption))
+		: KDevelop::Path(sourceSpace, "../build");
+
+	KDevelop::Path cacheDirectory = parser.isSet(outputOption)
+		? absolutePath(parser.value(outputOption))
+		: KDevelop::Path(buildSpace, ".kdevcatkin");
+
+	QString indexFileName = KDevelop::Path(cacheDirectory, "packages.index").toLocalFile();
+	QString snapshotFileName = KDevelop::Path(cacheDirectory, "session.snapshot").toLocalFile();
+
+	QTextStream out(stdout);
+	QTextStream err(stderr);
+
+	// Crawl, starting from the index of the last run
+	CatkinWorkspaceCrawler crawler;
+	crawler.loadIndex(indexFileName);
+
+	{
+		CatkinTrace::Span span("crawl", sourceSpace.toLocalFile());
+
+		QEventLoop loop;
+		QObject::connect(&crawler, &CatkinWorkspaceCrawler::finished,
+			&loop, &QEventLoop::quit, Qt::QueuedConnection);
+		crawler.start(sourceSpace);
+		loop.exec();
+	}
+
+	QVector<PackageInfo> packages;
+	for(const auto& package : crawler.takePackages())
+	{
+		// Invalid manifests, same as in the plugin
+		if(package.name.isEmpty())
+			continue;
+
+		PackageInfo info;
+		info.package = package;
+		info.package.buildPath = QFile::encodeName(KDevelop::Path(buildSpace, package.name).toLocalFile());
+		packages << info;
+	}
+
+	// Read the compilation databases in parallel
+	CatkinBuildInfoCache cache;
+	{
+		CatkinTrace::Span span("compile databases");
+
+		ThreadWeaver::Queue queue;
+		for(auto& package : packages)
+		{
+			PackageInfo* p = &package;
+			queue.enqueue(ThreadWeaver::make_job([p, &cache](){
+				CatkinCompileDatabase database;
+				database.load(QFile::decodeName(p->package.buildPath + "/compile_commands.json"), &cache);
+
+				for(const auto& file : database.files())
+				{
+					KDevelop::Path path(file);
+					CatkinBuildInfo info;
+					if(database.buildInfo(path, &info))
+						p->files.insert(path, info);
+				}
+			}));
+		}
+		queue.finish();
+	}
+
+	QVector<CatkinPackageIndex::Package> indexPackages;
+	CatkinSessionSnapshot snapshot;
+	int withBuildInfo = 0;
+
+	for(const auto& package : packages)
+	{
+		indexPackages << package.package;
+
+		// The plugin ignores packages that were not built
+		if(!QFileInfo(QFile::decodeName(package.package.buildPath)).isDir())
+			continue;
+
+		snapshot.addPackage(package.package.name,
+			KDevelop::Path(QFile::decodeName(package.package.path)), package.files);
+
+		if(!package.files.isEmpty())
+			withBuildInfo++;
+	}
+
+	if(!QDir().mkpath(cacheDirectory.toLocalFile()))
+	{
+		err << "Could not create " << cacheDirectory.toLocalFile() << '\n';
+		return 1;
+	}
+
+	if(!CatkinPackageIndex::save(indexFileName, crawler.takeDirectories(), indexPackages))
+	{
+		err << "Could not write " << indexFileName << '\n';
+		return 1;
+	}
+
+	if(!snapshot.save(snapshotFileName))
+	{
+		err << "Could not write " << snapshotFileName << '\n';
+		return 1;
+	}
+
+	out << indexPackages.size() << " packages, "
+		<< withBuildInfo << " with build information" << '\n';
+
+	CatkinTrace::write();
+
+	return 0;
+}
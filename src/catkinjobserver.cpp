@@ -0,0 +1,109 @@
+// GNU make jobserver shared by the packages of a build
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinjobserver.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QSocketNotifier>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+CatkinJobServer::CatkinJobServer(int jobs, QObject* parent)
+ : QObject(parent)
+{
+	// Only the processes of the build inherit the pipe, see inheritPipe()
+	int fds[2];
+	if(pipe2(fds, O_CLOEXEC) != 0)
+	{
+		qWarning() << "Could not create the jobserver pipe:" << strerror(errno);
+		return;
+	}
+
+	m_read = fds[0];
+	m_write = fds[1];
+
+	// A second file description of the same pipe, O_NONBLOCK on the
+	// inherited one would make the reads of make fail
+	m_poll = open(QByteArray("/proc/self/fd/" + QByteArray::number(m_read)).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(m_poll < 0)
+	{
+		qWarning() << "Could not open the jobserver pipe:" << strerror(errno);
+		return;
+	}
+
+	const QByteArray tokens(qBound(1, jobs, 4096), '+');
+	if(write(m_write, tokens.constData(), tokens.size()) != tokens.size())
+	{
+		qWarning() << "Could not fill the jobserver pipe:" << strerror(errno);
+		return;
+	}
+
+	m_notifier = new QSocketNotifier(m_poll, QSocketNotifier::Read, this);
+	m_notifier->setEnabled(false);
+	connect(m_notifier, &QSocketNotifier::activated, this, [this](){
+		m_notifier->setEnabled(false);
+		emit tokensAvailable();
+	});
+}
+
+CatkinJobServer::~CatkinJobServer()
+{
+	delete m_notifier;
+
+	for(int fd : {m_poll, m_read, m_write})
+	{
+		if(fd >= 0)
+			close(fd);
+	}
+}
+
+QString CatkinJobServer::makeFlags() const
+{
+	// GNU make 4.2 renamed the option to --jobserver-auth, but still accepts this one
+	return QStringLiteral("-j --jobserver-fds=%1,%2").arg(m_read).arg(m_write);
+}
+
+bool CatkinJobServer::tryAcquire()
+{
+	if(!isValid())
+		return true;
+
+	char token;
+	ssize_t ret;
+	do
+		ret = read(m_poll, &token, 1);
+	while(ret < 0 && errno == EINTR);
+
+	if(ret == 1)
+		return true;
+
+	m_notifier->setEnabled(true);
+	return false;
+}
+
+void CatkinJobServer::inheritPipe() const
+{
+	// Between fork() and exec(), only async-signal-safe calls
+	for(int fd : {m_read, m_write})
+	{
+		if(fd >= 0)
+			fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) & ~FD_CLOEXEC);
+	}
+}
+
+void CatkinJobServer::release()
+{
+	if(!isValid())
+		return;
+
+	const char token = '+';
+	ssize_t ret;
+	do
+		ret = write(m_write, &token, 1);
+	while(ret < 0 && errno == EINTR);
+}
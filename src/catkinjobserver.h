@@ -0,0 +1,73 @@
+// GNU make jobserver shared by the packages of a build
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINJOBSERVER_H
+#define CATKINJOBSERVER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+
+class QSocketNotifier;
+
+/**
+ * A GNU make jobserver: a pipe holding one token per make job.
+ *
+ * Every make started with makeFlags() in its MAKEFLAGS takes a token from
+ * the pipe for each job beyond its first one and puts it back when that
+ * job is done. The first job of a make is paid for by the owner, with
+ * tryAcquire() before starting the process and release() after it exited.
+ * That way the packages of a build share the make jobs as they need them,
+ * a package building alone gets all of them.
+ *
+ * tryAcquire() never blocks. After it failed, tokensAvailable() is emitted
+ * once there are tokens in the pipe again.
+ *
+ * The pipe is close-on-exec, only processes started as CatkinJobServerProcess
+ * inherit it. Without a pipe (isValid() is false), tryAcquire() always succeeds.
+ **/
+class CatkinJobServer : public QObject
+{
+Q_OBJECT
+public:
+	explicit CatkinJobServer(int jobs, QObject* parent = nullptr);
+	~CatkinJobServer() override;
+
+	bool isValid() const
+	{ return m_notifier; }
+
+	//! MAKEFLAGS for the make processes, understood by GNU make 3.78 and newer
+	QString makeFlags() const;
+
+	bool tryAcquire();
+	void release();
+
+	//! Lets the pipe survive the exec(), called in the forked child
+	void inheritPipe() const;
+Q_SIGNALS:
+	void tokensAvailable();
+private:
+	int m_read = -1;
+	int m_write = -1;
+
+	//! Non-blocking reader, the make processes need a blocking pipe
+	int m_poll = -1;
+	QSocketNotifier* m_notifier = nullptr;
+};
+
+//! A process sharing the make jobs of @p server
+class CatkinJobServerProcess : public QProcess
+{
+public:
+	explicit CatkinJobServerProcess(const CatkinJobServer* server, QObject* parent = nullptr)
+	 : QProcess(parent)
+	 , m_server(server)
+	{}
+protected:
+	void setupChildProcess() override
+	{ m_server->inheritPipe(); }
+private:
+	const CatkinJobServer* m_server;
+};
+
+#endif
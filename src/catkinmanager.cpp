@@ -2,22 +2,44 @@
 // Author: Max Schwarz <max.schwarz@online.de>
 
 #include "catkinmanager.h"
-
+#include "catkincompiledatabase.h"
+#include "catkinconfigstore.h"
+#include "catkinimportscheduler.h"
+#include "catkinsessionsnapshot.h"
+#include "catkinstubmanager.h"
+#include "catkintrace.h"
+#include "catkinworkspacecrawler.h"
+
+#include <QAction>
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
 #include <QDirIterator>
-#include <QStack>
-#include <QDomDocument>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
 
-#include <KPluginFactory>
+#include <KLocalizedString>
 #include <KDirWatch>
 #include <KJob>
 #include <KConfig>
 #include <KConfigGroup>
 
+#include <interfaces/context.h>
+#include <interfaces/contextmenuextension.h>
 #include <interfaces/iproject.h>
 #include <interfaces/icore.h>
+#include <interfaces/idocument.h>
+#include <interfaces/idocumentcontroller.h>
+#include <interfaces/ilanguagecontroller.h>
 #include <interfaces/iplugincontroller.h>
+#include <interfaces/iprojectcontroller.h>
+#include <interfaces/iruncontroller.h>
+
+#include <language/backgroundparser/backgroundparser.h>
+#include <language/duchain/topducontext.h>
 
 #include <serialization/indexedstring.h>
 
@@ -25,29 +47,127 @@
 
 #include <util/executecompositejob.h>
 
+#include <ThreadWeaver/ThreadWeaver>
+
+#include <algorithm>
+#include <functional>
+
 #include <unistd.h>
 
 using namespace KDevelop;
 
-K_PLUGIN_FACTORY_WITH_JSON(CatkinManagerFactory, "kdevcatkin.json", registerPlugin<CatkinManager>(); )
-
 namespace
 {
 
 class SubProjectFile : public KDevelop::ProjectFileItem
 {
 public:
-	SubProjectFile(IProject* project, const Path& path, KDevelop::ProjectFileItem* subProject, ProjectBaseItem* parent = nullptr)
+	SubProjectFile(IProject* project, const Path& path, CatkinSubProject* subProject, ProjectBaseItem* parent = nullptr)
 	 : ProjectFileItem(project, path, parent)
 	 , m_subProject(subProject)
 	{}
 
-	KDevelop::ProjectFileItem* subProjectItem()
+	CatkinSubProject* subProject() const
 	{ return m_subProject; }
+
+	/**
+	 * The corresponding item in the sub-project, nullptr if the sub-project
+	 * is not loaded. Outside the main thread, hold its treeLock().
+	 **/
+	KDevelop::ProjectFileItem* subProjectItem() const
+	{
+		if(!m_subProject->isOpen())
+			return nullptr;
+
+		auto items = m_subProject->filesForPath(indexedPath());
+		if(items.isEmpty())
+			return nullptr;
+
+		return items.first();
+	}
 private:
-	KDevelop::ProjectFileItem* m_subProject;
+	CatkinSubProject* m_subProject;
+};
+
+/**
+ * Memory use of project items, counted by sizeof() of the item classes and
+ * the allocations of their paths. The private data of the items is opaque,
+ * so this is a lower bound.
+ **/
+struct ItemStatistics
+{
+	qint64 items = 0;
+	qint64 bytes = 0;
+
+	void add(const KDevelop::ProjectBaseItem* item)
+	{
+		const qint64 size = item->file() ? sizeof(KDevelop::ProjectFileItem)
+			: item->folder() ? sizeof(KDevelop::ProjectFolderItem)
+			: item->target() ? sizeof(KDevelop::ProjectTargetItem)
+			: sizeof(KDevelop::ProjectBaseItem);
+
+		addItem(size, item->path().segments().size(), item->baseName().size());
+
+		for(auto child : item->children())
+			add(child);
+	}
+
+	//! An item of @p size whose path has @p segments, the last one @p nameLength characters long
+	void addItem(qint64 size, int segments, int nameLength)
+	{
+		// Every path has its own segment array, the segments themselves
+		// are shared with the path of the parent, except for the last one
+		items++;
+		bytes += size
+			+ sizeof(QArrayData) + segments * sizeof(QString)
+			+ sizeof(QArrayData) + (nameLength + 1) * sizeof(QChar);
+	}
+
+	//! Statistics for a fully listed @p path, without creating any items
+	static ItemStatistics forDirectory(const Path& path)
+	{
+		ItemStatistics stats;
+		const int segments = path.segments().size();
+		stats.addItem(sizeof(KDevelop::ProjectFolderItem), segments, path.lastPathSegment().size());
+
+		const QString root = path.toLocalFile();
+		QDirIterator it(root, QDir::AllEntries | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+		while(it.hasNext())
+		{
+			it.next();
+
+			const int depth = it.filePath().midRef(root.size()).count(QLatin1Char('/'));
+			const qint64 size = it.fileInfo().isDir() ? sizeof(KDevelop::ProjectFolderItem) : sizeof(KDevelop::ProjectFileItem);
+			stats.addItem(size, segments + depth, it.fileName().size());
+		}
+		return stats;
+	}
 };
 
+//! One package in the memory report, collected in the main thread
+struct MemoryReportPackage
+{
+	QString name;
+	Path path;
+	bool populated;
+	ItemStatistics tree;
+	ItemStatistics subProject;
+};
+
+//! Resident set size of the whole process, -1 if unknown
+qint64 residentSetSize()
+{
+	QFile file(QStringLiteral("/proc/self/statm"));
+	if(!file.open(QIODevice::ReadOnly))
+		return -1;
+
+	const QList<QByteArray> fields = file.readAll().split(' ');
+	if(fields.size() < 2)
+		return -1;
+
+	return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
 class SubProjectRoot : public KDevelop::ProjectFolderItem
 {
 public:
@@ -71,11 +191,76 @@ private:
 CatkinManager::CatkinManager(QObject* parent, const QVariantList&)
  : KDevelop::AbstractFileManagerPlugin(QStringLiteral("kdevcatkin"), parent)
 {
-	m_buildManager.reset(new CatkinBuildManager);
+	m_buildManager.reset(new CatkinBuildManager(this));
+
+	qRegisterMetaType<CatkinSubProject*>();
+
+	connect(core()->documentController(), &IDocumentController::documentOpened, this, [this](IDocument* document){
+		auto subProject = subprojectForPath(Path(document->url()));
+		if(!subProject)
+			return;
+
+		requestSubproject(subProject);
+
+		// The background parser picks up the document in the same event
+		// loop iteration, so look at it afterwards.
+		if(!subProject->isReady())
+		{
+			QUrl url = document->url();
+			QTimer::singleShot(0, this, [this, subProject, url](){
+				deferParsing(subProject, url);
+			});
+		}
+	});
+
+	// A document opened again is parsed from scratch anyway
+	connect(core()->documentController(), &IDocumentController::documentClosed, this, [this](IDocument* document){
+		m_parsedProvisionally.remove(IndexedString(document->url()));
+	});
+
+	// Keep the path lookup tables of the sub-projects up to date and drop
+	// cached build information when a sub-project (re)loads. All items in
+	// m_subProjectModel belong to a CatkinSubProject.
+	connect(&m_subProjectModel, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex& parent, int first, int last){
+		for(int row = first; row <= last; ++row)
+		{
+			auto item = m_subProjectModel.itemFromIndex(m_subProjectModel.index(row, 0, parent));
+			auto subProject = static_cast<CatkinSubProject*>(item->project());
+			subProject->addItems(item);
+			m_buildInfoCache.invalidate(subProject);
+		}
+	});
+	connect(&m_subProjectModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, [this](const QModelIndex& parent, int first, int last){
+		for(int row = first; row <= last; ++row)
+		{
+			auto item = m_subProjectModel.itemFromIndex(m_subProjectModel.index(row, 0, parent));
+			auto subProject = static_cast<CatkinSubProject*>(item->project());
+			subProject->removeItems(item);
+			m_buildInfoCache.invalidate(subProject);
+		}
+	});
+
+	connect(core()->projectController(), &IProjectController::projectClosing,
+		this, &CatkinManager::closeWorkspace);
+
+	connect(&m_unloadTimer, &QTimer::timeout, this, &CatkinManager::unloadIdleSubprojects);
+	m_unloadTimer.start(60 * 1000);
+
+	// A checkout or a git operation touches many directories at once
+	m_rescanTimer.setSingleShot(true);
+	m_rescanTimer.setInterval(1000);
+	connect(&m_rescanTimer, &QTimer::timeout, this, &CatkinManager::rescanDirectories);
+
+	connect(&m_dirWatch, &KDirWatch::dirty, this, [this](const QString& path){
+		m_dirtyDirectories.insert(path);
+		m_rescanTimer.start();
+	});
 }
 
 CatkinManager::~CatkinManager()
 {
+	qDeleteAll(m_configStores);
+	CatkinTrace::write();
 }
 
 KDevelop::ProjectFolderItem *CatkinManager::import(KDevelop::IProject *project)
@@ -83,161 +268,380 @@ KDevelop::ProjectFolderItem *CatkinManager::import(KDevelop::IProject *project)
 	return AbstractFileManagerPlugin::import(project);
 }
 
-class ListPackagesJob : public KDevelop::ExecuteCompositeJob
+/**
+ * Opens a sub-project and runs its CMake import
+ **/
+class LoadSubprojectJob : public KJob
 {
 Q_OBJECT
 public:
-	ListPackagesJob(IProject* project, CatkinManager* manager)
-	 : ExecuteCompositeJob(manager, {})
+	LoadSubprojectJob(CatkinSubProject* project, ProjectModel* model, IProjectFileManager* cmakeManager, QObject* parent)
+	 : KJob(parent)
 	 , project(project)
-	 , manager(manager)
+	 , model(model)
+	 , cmakeManager(cmakeManager)
 	{
+		setCapabilities(KJob::Killable);
 	}
 
-	void processPackage(const KDevelop::Path& packageXmlPath)
+	void start() override
+	{
+		CatkinTrace::begin("load", traceId, project->name());
+		CatkinTrace::begin("open", traceId, project->name());
+
+		project->setState(CatkinSubProject::Opening);
+
+		auto openJob = project->open();
+		connect(openJob, &KJob::result, this, &LoadSubprojectJob::opened);
+		current = openJob;
+		openJob->start();
+	}
+protected:
+	bool doKill() override
 	{
-		QFile packageXml(packageXmlPath.toLocalFile());
-		QDomDocument doc;
+		// Not started yet
+		if(!current)
+			return true;
 
-		QString errorMsg;
-		int errorLine, errorColumn;
-		if(!doc.setContent(&packageXml, &errorMsg, &errorLine, &errorColumn))
+		if(!current->kill(KJob::Quietly))
+			return false;
+
+		if(importing)
 		{
-			fprintf(stderr, "Could not parse package XML '%s':%d:%d: %s\n",
-				qPrintable(packageXmlPath.toLocalFile()),
-				errorLine, errorColumn,
-				qPrintable(errorMsg)
-			);
-			return;
+			CatkinTrace::end("cmake import", traceId);
+
+			// Drop the half-imported tree, the package starts over next time
+			project->unload();
 		}
+		else
+			CatkinTrace::end("open", traceId);
 
-		QDomElement packageElem = doc.namedItem("package").toElement();
-		if(packageElem.isNull())
+		// Timed out or cancelled. Documents waiting for the package (see
+		// deferParsing()) are parsed without build information now.
+		project->setState(CatkinSubProject::Failed);
+
+		CatkinTrace::end("load", traceId);
+		current = nullptr;
+		return true;
+	}
+private:
+	void opened(KJob* openJob)
+	{
+		CatkinTrace::end("open", traceId);
+		current = nullptr;
+
+		if(openJob->error())
 		{
-			qWarning()
-				<< "No <package> element found for package at"
-				<< packageXmlPath.toLocalFile();
+			qWarning() << "Could not open project" << project->name() << ":" << openJob->errorString();
+			setError(openJob->error());
+			setErrorText(openJob->errorText());
+			CatkinTrace::end("load", traceId);
+			project->setState(CatkinSubProject::Failed);
+			emitResult();
 			return;
 		}
 
-		QDomElement nameElem = packageElem.namedItem("name").toElement();
-		if(nameElem.isNull())
-		{
-			qWarning()
-				<< "No <name> element found for package at "
-				<< packageXmlPath.toLocalFile();
+		model->appendRow(project->projectItem());
+
+		CatkinTrace::begin("cmake import", traceId, project->name());
+
+		project->setState(CatkinSubProject::Importing);
+
+		auto importJob = cmakeManager->createImportJob(project->projectItem());
+		connect(importJob, &KJob::result, this, [this](KJob* importJob){
+			qDebug() << "=========================== Subproject import for" << project->name() << "finished ========================";
+
+			current = nullptr;
+
+			CatkinTrace::end("cmake import", traceId);
+			CatkinTrace::end("load", traceId);
+
+			setError(importJob->error());
+			setErrorText(importJob->errorText());
+			project->setState(importJob->error() ? CatkinSubProject::Failed : CatkinSubProject::Ready);
+			emitResult();
+		});
+		current = importJob;
+		importing = true;
+		importJob->start();
+	}
+
+	CatkinSubProject* const project;
+	ProjectModel* const model;
+	IProjectFileManager* const cmakeManager;
+
+	//! The running step, for killing
+	KJob* current = nullptr;
+	bool importing = false;
+	const quint64 traceId = CatkinTrace::newId();
+};
+
+class ListPackagesJob : public KJob
+{
+Q_OBJECT
+public:
+	ListPackagesJob(IProject* project, CatkinManager* manager)
+	 : KJob(manager)
+	 , project(project)
+	 , manager(manager)
+	 , scheduler(new CatkinImportScheduler(this))
+	{
+		setCapabilities(KJob::Killable);
+	}
+
+	void processPackage(CatkinPackageIndex::Package package)
+	{
+		KDevelop::Path packageXmlPath(Path(QFile::decodeName(package.path)), "package.xml");
+
+		// The crawler already complained about invalid manifests
+		if(package.name.isEmpty())
 			return;
-		}
 
-		QString name = nameElem.text();
+		QString name = package.name;
+
+		KDevelop::Path projectBuildPath(CatkinManager::buildSpace(project), name);
+		package.buildPath = QFile::encodeName(projectBuildPath.toLocalFile());
 
-		KDevelop::Path buildPath(project->path(), "../build");
-		KDevelop::Path projectBuildPath(buildPath, name);
+		// Remember the package for the next crawl, even if we cannot use it now
+		packages << package;
 
-		if(!QFileInfo(projectBuildPath.toLocalFile()).isDir())
+		KDevelop::Path projectSourcePath(packageXmlPath.parent());
+
+		// Restored from the snapshot and still there?
+		auto subProject = restored.take(projectSourcePath);
+		if(subProject && subProject->name() != name)
 		{
-			qWarning() << "No build directory found for package" << name;
-			return;
+			manager->removeSubproject(subProject);
+			subProject = nullptr;
 		}
 
-		// Do we already have a project file in place?
-		KDevelop::Path projectSourcePath(packageXmlPath.parent());
-		KDevelop::Path projectFilePath(projectSourcePath, QString("%1.kdev4").arg(name));
+		if(!subProject)
+			subProject = manager->createSubproject(project, name, projectSourcePath, configStore);
+		if(!subProject)
+			return;
+
+		// Packages the user is looking at are imported first. They are
+		// needed even in lazy mode, their documents were opened before
+		// the package was known.
+		bool urgent = std::any_of(openDocuments.begin(), openDocuments.end(), [&](const Path& path){
+			return projectSourcePath.isParentOf(path);
+		});
 
-		if(!QFile::exists(projectFilePath.toLocalFile()))
+		if(urgent)
+			manager->populateTree(subProject);
+
+		// In lazy mode, the package is loaded once it is needed
+		if(lazy && !urgent)
+			return;
+
+		// An interrupted import resumes with the packages it did not get
+		// to, the ones imported before go last.
+		if(!urgent && snapshot && snapshot->isIncomplete())
 		{
-			KSharedConfigPtr cfg = KSharedConfig::openConfig(projectFilePath.toLocalFile(), KConfig::SimpleConfig);
-			if(!cfg->isConfigWritable(true))
+			auto previous = snapshot->package(projectSourcePath);
+			if(previous && previous->imported)
 			{
-				qWarning() << "Can't write to config file";
+				deferred << subProject;
 				return;
 			}
-
-			KConfigGroup grp = cfg->group("Project");
-			grp.writeEntry("Name", name);
-			grp.writeEntry("CreatedFrom", "CMakeLists.txt");
-			grp.writeEntry("Manager", "KDevCMakeManager");
-			cfg->sync();
 		}
 
-		auto project = new CatkinSubProject(manager);
+		scheduler->enqueue(manager->loadSubproject(subProject), name, urgent);
+	}
 
-		if(!project->open(projectFilePath, projectBuildPath, manager->cmakePlugin()))
+	void start() override
+	{
+		KConfigGroup group(project->projectConfiguration(), "Catkin");
+		lazy = group.readEntry("Lazy Loading", false);
+
+		if(group.readEntry("Consolidated Configuration", false))
+			configStore = manager->configStore(project);
+		scheduler->setMaximumConcurrency(group.readEntry("Parallel Imports", QThread::idealThreadCount()));
+		scheduler->setTimeout(1000 * group.readEntry("Import Timeout", 300));
+
+		for(auto document : ICore::self()->documentController()->openDocuments())
+			openDocuments << Path(document->url());
+
+		// The packages of the last session are available right away,
+		// the crawl below confirms them.
+		snapshot = manager->restoreSnapshot(project);
+		if(snapshot)
 		{
-			qWarning("Could not open project");
-			return;
+			for(const auto& package : snapshot->packages())
+			{
+				if(auto subProject = manager->createSubproject(project, package.name, package.path, configStore))
+					restored.insert(package.path, subProject);
+			}
 		}
 
-		manager->addSubproject(project);
+		CatkinTrace::begin("workspace import", traceId, project->name());
 
-		auto job = manager->cmakeManager()->createImportJob(project->projectItem());
+		connect(scheduler, &KJob::result, this, [this](){
+			// Write the configuration of all packages at once
+			if(configStore)
+				configStore->sync();
 
-		connect(job, &KJob::result, this, [project](){
-			qDebug() << "=========================== Subproject import for" << project->name() << "finished ========================";
+			CatkinTrace::end("workspace import", traceId);
+			CatkinTrace::write();
+
+			emitResult();
+		});
+		connect(scheduler, &KJob::percent, this, [this](KJob*, unsigned long percent){
+			setPercent(percent);
+		});
+		scheduler->start();
+
+		// Crawl for packages. Packages are processed as they come in,
+		// the CMake imports start right away.
+		crawler = new CatkinWorkspaceCrawler(this);
+		crawler->loadIndex(indexFileName());
+
+		connect(crawler, &CatkinWorkspaceCrawler::packagesAvailable,
+			this, &ListPackagesJob::processPackages);
+		connect(crawler, &CatkinWorkspaceCrawler::finished, this, [this](){
+			CatkinTrace::end("crawl", traceId);
+			crawled = true;
+			processPackages();
+
+			// Whatever the crawl did not confirm is gone
+			for(auto subProject : restored)
+				manager->removeSubproject(subProject);
+			restored.clear();
+			saveIndex();
+
+			for(auto subProject : deferred)
+				scheduler->enqueue(manager->loadSubproject(subProject), subProject->name());
+			deferred.clear();
+
+			scheduler->setInputComplete();
 		});
 
-		addSubjob(job);
+		CatkinTrace::begin("crawl", traceId, project->name());
+		crawler->start(project->path());
 	}
 
-	void start() override
+	void processPackages()
 	{
-		KDevelop::Path projectPath = project->path();
+		for(const auto& package : crawler->takePackages())
+			processPackage(package);
+	}
 
-		KDevelop::Path srcPath(projectPath);
+	QString indexFileName() const
+	{
+		return Path(CatkinManager::cacheDirectory(project), "packages.index").toLocalFile();
+	}
 
-		// Crawl for packages.
-		QStack<KDevelop::Path> fringe;
-		fringe.push(srcPath);
+	void saveIndex()
+	{
+		auto directories = crawler->takeDirectories();
 
-		while(!fringe.isEmpty())
-		{
-			Path path = fringe.pop();
-			QDir dir(path.toLocalFile());
+		// From now on, packages are added and removed as they come and go
+		manager->watchDirectories(project, directories);
 
-			Path ignoreFile(path, "CATKIN_IGNORE");
-			if(QFile::exists(ignoreFile.toLocalFile()))
-				continue;
+		QDir().mkpath(CatkinManager::cacheDirectory(project).toLocalFile());
+		CatkinPackageIndex::save(indexFileName(), directories, packages);
+	}
 
-			Path packageFile(path, "package.xml");
-			if(QFile::exists(packageFile.toLocalFile()))
-			{
-				processPackage(packageFile);
-			}
+protected:
+	bool doKill() override
+	{
+		// Keep what the crawl found so far, every directory in there was
+		// read completely. The next crawl only reads the rest.
+		if(crawler && !crawled)
+		{
+			crawler->disconnect(this);
+			crawler->cancel();
+			CatkinTrace::end("crawl", traceId);
 
-			QDirIterator it(path.toLocalFile());
-			while(it.hasNext())
-			{
-				it.next();
+			for(const auto& package : crawler->takePackages())
+				packages << package;
+			saveIndex();
+		}
 
-				auto info = it.fileInfo();
-				if(info.fileName().startsWith('.'))
-					continue;
+		// Kills the running imports, the packages are imported first thing
+		// next time (see the session snapshot).
+		scheduler->disconnect(this);
+		scheduler->kill(KJob::Quietly);
 
-				if(info.isDir())
-					fringe.push(Path(path, info.fileName()));
-			}
-		}
+		if(configStore)
+			configStore->sync();
 
-		ExecuteCompositeJob::start();
+		CatkinTrace::end("workspace import", traceId);
+		return true;
 	}
-
 private:
 	IProject* const project;
 	CatkinManager* const manager;
+	CatkinImportScheduler* const scheduler;
+	CatkinWorkspaceCrawler* crawler = nullptr;
+	const quint64 traceId = CatkinTrace::newId();
+	QVector<CatkinPackageIndex::Package> packages;
+	QVector<Path> openDocuments;
+	std::shared_ptr<const CatkinSessionSnapshot> snapshot;
+	QHash<Path, CatkinSubProject*> restored;
+	QVector<CatkinSubProject*> deferred;
+	bool crawled = false;
+	bool lazy = false;
+	CatkinConfigStore* configStore = nullptr;
 };
 
+KDevelop::Path CatkinManager::buildSpace(KDevelop::IProject* project)
+{
+	return KDevelop::Path(project->path(), "../build");
+}
+
+KDevelop::Path CatkinManager::develSpace(KDevelop::IProject* project)
+{
+	return KDevelop::Path(project->path(), "../devel");
+}
+
+KDevelop::Path CatkinManager::installSpace(KDevelop::IProject* project)
+{
+	return KDevelop::Path(project->path(), "../install");
+}
+
+QProcessEnvironment CatkinManager::buildEnvironment(KDevelop::IProject* project)
+{
+	QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+
+	QString prefixPath = develSpace(project).toLocalFile();
+	if(environment.contains(QStringLiteral("CMAKE_PREFIX_PATH")))
+		prefixPath += QLatin1Char(':') + environment.value(QStringLiteral("CMAKE_PREFIX_PATH"));
+	environment.insert(QStringLiteral("CMAKE_PREFIX_PATH"), prefixPath);
+
+	return environment;
+}
+
+KDevelop::Path CatkinManager::cacheDirectory(KDevelop::IProject* project)
+{
+	return KDevelop::Path(buildSpace(project), ".kdevcatkin");
+}
+
+void CatkinManager::setCMakeManager(KDevelop::IPlugin* plugin)
+{
+	Q_ASSERT(plugin);
+	m_cmakePlugin = plugin;
+	m_cmakeManager = plugin->extension<KDevelop::IProjectFileManager>();
+	Q_ASSERT(m_cmakeManager);
+}
+
 KJob* CatkinManager::createImportJob(KDevelop::ProjectFolderItem* item)
 {
 	if(!m_cmakeManager)
 	{
-		m_cmakePlugin = core()->pluginController()->pluginForExtension(QStringLiteral("org.kdevelop.IProjectFileManager"), QStringLiteral("KDevCMakeManager"));
-		Q_ASSERT(m_cmakePlugin);
-		m_cmakeManager = m_cmakePlugin->extension<KDevelop::IProjectFileManager>();
-		Q_ASSERT(m_cmakeManager);
+		// Load tests replace CMake with a stub
+		if(auto stub = CatkinStubManager::fromEnvironment(this))
+			setCMakeManager(stub);
+		else
+			setCMakeManager(core()->pluginController()->pluginForExtension(QStringLiteral("org.kdevelop.IProjectFileManager"), QStringLiteral("KDevCMakeManager")));
 	}
 
 	auto project = item->project();
 
+	KConfigGroup group(project->projectConfiguration(), "Catkin");
+	if(group.readEntry("Lazy Tree", false))
+		m_lazyTree.insert(project);
+
 	auto job = new ListPackagesJob(project, this);
 	connect(job, &KJob::result, this, [job](){
 		if (job->error() != 0) {
@@ -245,15 +649,37 @@ KJob* CatkinManager::createImportJob(KDevelop::ProjectFolderItem* item)
 		}
 	});
 
+	auto fileTreeJob = KDevelop::AbstractFileManagerPlugin::createImportJob(item); // generate the file system listing
+	const quint64 traceId = CatkinTrace::newId();
+	CatkinTrace::begin("file tree", traceId, project->name());
+	connect(fileTreeJob, &KJob::result, this, [traceId](){
+		CatkinTrace::end("file tree", traceId);
+	});
+
 	const QList<KJob*> jobs = {
 		job,
-		KDevelop::AbstractFileManagerPlugin::createImportJob(item) // generate the file system listing
+		fileTreeJob
 	};
 
 	Q_ASSERT(!jobs.contains(nullptr));
 	ExecuteCompositeJob* composite = new ExecuteCompositeJob(this, jobs);
 	//     even if the cmake call failed, we want to load the project so that the project can be worked on
 	composite->setAbortOnError(false);
+
+	m_importJobs.insert(project, composite);
+	connect(composite, &KJob::result, this, [this, project, composite](){
+		// Killed by closeWorkspace(), which takes care of the rest
+		if(m_importJobs.value(project) != composite)
+			return;
+
+		m_importJobs.remove(project);
+		writeMemoryReport(project);
+
+		// Checkpoint, the next import continues where this one stopped
+		if(composite->error() == KJob::KilledJobError)
+			saveSnapshot(project);
+	});
+
 	return composite;
 }
 
@@ -263,6 +689,15 @@ bool CatkinManager::isValid(const Path& path, const bool isFolder, KDevelop::IPr
 	if(path.lastPathSegment().endsWith(".kdev4"))
 		return false;
 
+	// Contents of packages nobody looked at yet are listed on demand,
+	// see populateTree().
+	if(m_lazyTree.contains(project))
+	{
+		auto subProject = subprojectForPath(path);
+		if(subProject && subProject->path() != path && !m_populated.contains(subProject))
+			return false;
+	}
+
 	return AbstractFileManagerPlugin::isValid(path, isFolder, project);
 }
 
@@ -271,6 +706,50 @@ KDevelop::IProjectBuilder* CatkinManager::builder() const
 	return m_buildManager.get();
 }
 
+KDevelop::ContextMenuExtension CatkinManager::contextMenuExtension(KDevelop::Context* context, QWidget* parent)
+{
+	KDevelop::ContextMenuExtension extension = AbstractFileManagerPlugin::contextMenuExtension(context, parent);
+	if(context->type() != KDevelop::Context::ProjectItemContext)
+		return extension;
+
+	auto items = static_cast<KDevelop::ProjectItemContext*>(context)->items();
+	if(items.size() != 1 || items.first()->project()->projectFileManager() != this)
+		return extension;
+
+	// The item may be gone when the action is triggered, look it up again
+	QPointer<IProject> workspace = items.first()->project();
+	IndexedString path(items.first()->path().pathOrUrl());
+
+	auto addAction = [&](const QString& icon, const QString& text, std::function<KJob*(ProjectBaseItem*)> create){
+		auto action = new QAction(QIcon::fromTheme(icon), text, parent);
+		connect(action, &QAction::triggered, this, [workspace, path, create](){
+			if(!workspace)
+				return;
+
+			auto items = workspace->itemsForPath(path);
+			if(items.isEmpty())
+				return;
+
+			if(KJob* job = create(items.first()))
+				ICore::self()->runController()->registerJob(job);
+		});
+		extension.addAction(KDevelop::ContextMenuExtension::BuildGroup, action);
+	};
+
+	auto buildManager = m_buildManager;
+	addAction(QStringLiteral("run-build"), i18n("Show Packages to Build"), [buildManager](ProjectBaseItem* item){
+		return buildManager->dryRun(item);
+	});
+	addAction(QStringLiteral("system-run"), i18n("Run Tests"), [buildManager](ProjectBaseItem* item){
+		return buildManager->test(item);
+	});
+	addAction(QStringLiteral("system-run"), i18n("Run Affected Tests"), [buildManager](ProjectBaseItem* item){
+		return buildManager->test(item, true);
+	});
+
+	return extension;
+}
+
 KDevelop::ProjectTargetItem * CatkinManager::createTarget(const QString& target, KDevelop::ProjectFolderItem* parent)
 {
 	return 0;
@@ -296,79 +775,174 @@ bool CatkinManager::removeTarget(KDevelop::ProjectTargetItem* target)
 	return false;
 }
 
-bool CatkinManager::hasBuildInfo(KDevelop::ProjectBaseItem* item) const
+KDevelop::ProjectFileItem* CatkinManager::subProjectItem(KDevelop::ProjectBaseItem* item) const
 {
 	auto fileItem = dynamic_cast<SubProjectFile*>(item);
+	if(!fileItem)
+		return nullptr;
 
-	if(fileItem)
+	auto subProject = fileItem->subProject();
+	subProject->touch();
+
+	if(!subProject->isOpen())
 	{
-		auto buildManager = fileItem->subProjectItem()->project()->buildSystemManager();
-		if(!buildManager)
-			return false;
+		// We are usually called from parse jobs, so load the package
+		// on the main thread.
+		QMetaObject::invokeMethod(
+			const_cast<CatkinManager*>(this), "requestSubproject",
+			Qt::QueuedConnection, Q_ARG(CatkinSubProject*, subProject)
+		);
+		return nullptr;
+	}
+
+	return fileItem->subProjectItem();
+}
 
-		bool available = buildManager->hasBuildInfo(fileItem->subProjectItem());
+bool CatkinManager::buildInfo(KDevelop::ProjectBaseItem* item, CatkinBuildInfo* info) const
+{
+	auto fileItem = dynamic_cast<SubProjectFile*>(item);
+	if(!fileItem)
+		return false;
+
+	CatkinTrace::Span span("build info", CatkinTrace::isEnabled() ? item->path().pathOrUrl() : QString());
 
-		return available;
+	{
+		// Keeps the sub-project tree alive until we are done with its item
+		QReadLocker lock(fileItem->subProject()->treeLock());
+
+		auto subItem = subProjectItem(item);
+		if(subItem && importedBuildInfo(subItem, info))
+			return true;
 	}
 
-	return false;
+	// Until the CMake import is done, answer from the last session or build
+	return provisionalBuildInfo(fileItem->subProject(), item->path(), info);
 }
 
-KDevelop::Path CatkinManager::buildDirectory(KDevelop::ProjectBaseItem*) const
+bool CatkinManager::provisionalBuildInfo(CatkinSubProject* project, const KDevelop::Path& file, CatkinBuildInfo* info) const
 {
-	return {};
+	std::shared_ptr<const CatkinSessionSnapshot> snapshot;
+	{
+		QMutexLocker lock(&m_snapshotMutex);
+		snapshot = m_snapshots.value(project->workspace());
+	}
+
+	if(snapshot && snapshot->buildInfo(project->path(), file, info))
+		return true;
+
+	return compileDatabase(project)->buildInfo(file, info);
 }
 
-KDevelop::Path::List CatkinManager::frameworkDirectories(KDevelop::ProjectBaseItem* item) const
+bool CatkinManager::importedBuildInfo(KDevelop::ProjectFileItem* subItem, CatkinBuildInfo* info) const
 {
-	auto fileItem = dynamic_cast<SubProjectFile*>(item);
+	auto subProject = static_cast<CatkinSubProject*>(subItem->project());
 
-	if(fileItem)
+	// Files of the same target share their build information
+	const KDevelop::ProjectBaseItem* key = subItem;
+	for(auto fileItem : subProject->filesForPath(subItem->indexedPath()))
 	{
-		auto buildManager = fileItem->subProjectItem()->project()->buildSystemManager();
-		if(!buildManager)
-			return {};
+		if(fileItem->parent() && fileItem->parent()->target())
+		{
+			key = fileItem->parent();
+			break;
+		}
+	}
 
-		auto directories = buildManager->frameworkDirectories(fileItem->subProjectItem());
+	if(m_buildInfoCache.lookup(subProject, key, info))
+		return true;
 
-		return directories;
-	}
+	auto buildManager = subProject->buildSystemManager();
+	if(!buildManager)
+		return false;
 
-	return {};
+	// Don't cache anything while the import is still running
+	if(!buildManager->hasBuildInfo(subItem))
+		return false;
+
+	CatkinBuildInfo fresh;
+	fresh.includeDirectories = buildManager->includeDirectories(subItem);
+	fresh.frameworkDirectories = buildManager->frameworkDirectories(subItem);
+	fresh.defines = buildManager->defines(subItem);
+	fresh.extraArguments = buildManager->extraArguments(subItem);
+
+	*info = m_buildInfoCache.insert(subProject, key, fresh);
+	return true;
 }
 
-KDevelop::Path::List CatkinManager::includeDirectories(KDevelop::ProjectBaseItem* item) const
+std::shared_ptr<const CatkinCompileDatabase> CatkinManager::compileDatabase(CatkinSubProject* project) const
 {
-	auto fileItem = dynamic_cast<SubProjectFile*>(item);
+	QMutexLocker lock(&m_compileDatabaseMutex);
 
-	if(fileItem)
+	auto& database = m_compileDatabases[project];
+	if(!database)
 	{
-		auto buildManager = fileItem->subProjectItem()->project()->buildSystemManager();
-		if(!buildManager)
-			return {};
+		auto fresh = std::make_shared<CatkinCompileDatabase>();
+		fresh->load(
+			KDevelop::Path(project->buildPath(), "compile_commands.json").toLocalFile(),
+			&m_buildInfoCache
+		);
+		database = fresh;
+	}
 
-		auto directories = buildManager->includeDirectories(fileItem->subProjectItem());
+	return database;
+}
 
-		return directories;
-	}
+bool CatkinManager::hasBuildInfo(KDevelop::ProjectBaseItem* item) const
+{
+	CatkinBuildInfo info;
+	return buildInfo(item, &info);
+}
 
-	return {};
+KDevelop::Path CatkinManager::buildDirectory(KDevelop::ProjectBaseItem* item) const
+{
+	KDevelop::Path folder = item->folder() ? item->path() : item->path().parent();
+
+	auto subProject = subprojectForPath(folder);
+	if(!subProject)
+		return buildSpace(item->project());
+
+	// The CMake binary tree mirrors the source tree it was configured from
+	KDevelop::Path binaryDir = subProject->buildPath();
+	KDevelop::Path sourceDir = subProject->path();
+
+	const QString cachedBinaryDir = m_cmakeCache.value(binaryDir, "CMAKE_CACHEFILE_DIR");
+	const QString cachedSourceDir = m_cmakeCache.value(binaryDir, "CMAKE_HOME_DIRECTORY");
+	if(!cachedBinaryDir.isEmpty())
+		binaryDir = KDevelop::Path(cachedBinaryDir);
+	if(!cachedSourceDir.isEmpty())
+		sourceDir = KDevelop::Path(cachedSourceDir);
+
+	if(folder != sourceDir && !sourceDir.isParentOf(folder))
+		return binaryDir;
+
+	return KDevelop::Path(binaryDir, sourceDir.relativePath(folder));
 }
 
-QHash<QString, QString> CatkinManager::defines(KDevelop::ProjectBaseItem* item) const
+KDevelop::Path::List CatkinManager::frameworkDirectories(KDevelop::ProjectBaseItem* item) const
 {
-	auto fileItem = dynamic_cast<SubProjectFile*>(item);
+	CatkinBuildInfo info;
+	if(!buildInfo(item, &info))
+		return {};
 
-	if(fileItem)
-	{
-		auto buildManager = fileItem->subProjectItem()->project()->buildSystemManager();
-		if(!buildManager)
-			return {};
+	return info.frameworkDirectories;
+}
 
-		return buildManager->defines(fileItem->subProjectItem());
-	}
+KDevelop::Path::List CatkinManager::includeDirectories(KDevelop::ProjectBaseItem* item) const
+{
+	CatkinBuildInfo info;
+	if(!buildInfo(item, &info))
+		return {};
 
-	return {};
+	return info.includeDirectories;
+}
+
+QHash<QString, QString> CatkinManager::defines(KDevelop::ProjectBaseItem* item) const
+{
+	CatkinBuildInfo info;
+	if(!buildInfo(item, &info))
+		return {};
+
+	return info.defines;
 }
 
 bool CatkinManager::reload(KDevelop::ProjectFolderItem* item)
@@ -377,6 +951,13 @@ bool CatkinManager::reload(KDevelop::ProjectFolderItem* item)
 
 	if(folderItem)
 	{
+		// Not loaded yet (lazy mode)? Then this is a request to load it.
+		if(!folderItem->subProject()->isOpen())
+		{
+			requestSubproject(folderItem->subProject());
+			return true;
+		}
+
 		qWarning() << "Reloading sub project";
 		auto fileManager = folderItem->subProject()->projectFileManager();
 		if(!fileManager)
@@ -385,78 +966,614 @@ bool CatkinManager::reload(KDevelop::ProjectFolderItem* item)
 		return fileManager->reload(folderItem->subProject()->projectItem());
 	}
 
+	// Pick up packages that were added or removed below the folder
+	if(m_watchedDirectories.value(item->project()).contains(item->path().toLocalFile()))
+	{
+		m_dirtyDirectories.insert(item->path().toLocalFile());
+		m_rescanTimer.start();
+	}
+
 	return KDevelop::AbstractFileManagerPlugin::reload(item);
 }
 
 
 QString CatkinManager::extraArguments(KDevelop::ProjectBaseItem* item) const
 {
-	auto fileItem = dynamic_cast<SubProjectFile*>(item);
+	CatkinBuildInfo info;
+	if(!buildInfo(item, &info))
+		return QString();
+
+	return info.extraArguments;
+}
+
+CatkinSubProject* CatkinManager::createSubproject(KDevelop::IProject* workspace, const QString& name, const KDevelop::Path& sourcePath, CatkinConfigStore* configStore)
+{
+	KDevelop::Path buildPath(buildSpace(workspace), name);
+	if(!QFileInfo(buildPath.toLocalFile()).isDir())
+	{
+		qWarning() << "No build directory found for package" << name;
+		return nullptr;
+	}
 
-	if(fileItem)
+	// Do we already have a project file in place?
+	KDevelop::Path projectFilePath(sourcePath, QString("%1.kdev4").arg(name));
+
+	if(!configStore && !QFile::exists(projectFilePath.toLocalFile()))
 	{
-		auto buildManager = fileItem->subProjectItem()->project()->buildSystemManager();
-		if(!buildManager)
-			return QString();
+		KSharedConfigPtr cfg = KSharedConfig::openConfig(projectFilePath.toLocalFile(), KConfig::SimpleConfig);
+		if(!cfg->isConfigWritable(true))
+		{
+			qWarning() << "Can't write to config file";
+			return nullptr;
+		}
 
-		return buildManager->extraArguments(fileItem->subProjectItem());
+		KConfigGroup grp = cfg->group("Project");
+		grp.writeEntry("Name", name);
+		grp.writeEntry("CreatedFrom", "CMakeLists.txt");
+		grp.writeEntry("Manager", "KDevCMakeManager");
+		cfg->sync();
 	}
 
-	return QString();
+	auto subProject = new CatkinSubProject(
+		workspace, name, projectFilePath, buildPath,
+		m_cmakePlugin, this
+	);
+
+	subProject->setConfigStore(configStore);
+	addSubproject(subProject);
+
+	return subProject;
 }
 
 void CatkinManager::addSubproject(CatkinSubProject* project)
 {
 	m_subProjects << project;
-	m_subProjectModel.appendRow(project->projectItem());
+	m_pathIndex.insert(project->path(), project);
+
+	connect(project, &CatkinSubProject::stateChanged, this, [this](CatkinSubProject* project, CatkinSubProject::State state){
+		// The workspace might have been closed in the meantime
+		if(!m_subProjects.contains(project))
+			return;
+
+		// Failed packages are parsed without build information, but
+		// they are parsed.
+		if(state == CatkinSubProject::Ready || state == CatkinSubProject::Failed)
+			reparseOpenDocuments(project);
+	});
+	connect(project, &CatkinSubProject::reloadRequested, this, [this](CatkinSubProject* project){
+		if(m_loading.contains(project))
+			return;
+
+		project->unload();
+		requestSubproject(project);
+	});
 }
 
-KDevelop::ProjectFileItem* CatkinManager::createFileItem(KDevelop::IProject* project, const KDevelop::Path& path, KDevelop::ProjectBaseItem* parent)
+KJob* CatkinManager::loadSubproject(CatkinSubProject* project)
 {
-	KDevelop::IndexedString indexedPath(path.toLocalFile());
+	auto job = new LoadSubprojectJob(project, &m_subProjectModel, m_cmakeManager, this);
 
-	auto it = std::find_if(m_subProjects.begin(), m_subProjects.end(), [&](CatkinSubProject* subProj){
-		return subProj->inProject(indexedPath);
+	// finished() also comes when the job is killed quietly, e.g. by the
+	// scheduler on a timeout, result() does not.
+	m_loading.insert(project);
+	connect(job, &KJob::finished, this, [this, project](){
+		m_loading.remove(project);
 	});
 
-	if(it != m_subProjects.end())
+	return job;
+}
+
+void CatkinManager::requestSubproject(CatkinSubProject* project)
+{
+	project->touch();
+	populateTree(project);
+
+	if(project->isOpen() || m_loading.contains(project))
+		return;
+
+	core()->runController()->registerJob(loadSubproject(project));
+}
+
+void CatkinManager::populateTree(CatkinSubProject* project)
+{
+	if(!m_lazyTree.contains(project->workspace()) || m_populated.contains(project))
+		return;
+
+	m_populated.insert(project);
+
+	// Before the file tree import, the package is listed with the rest
+	for(auto folder : project->workspace()->foldersForPath(IndexedString(project->path().pathOrUrl())))
+		AbstractFileManagerPlugin::reload(folder);
+}
+
+void CatkinManager::depopulateTree(CatkinSubProject* project)
+{
+	if(!m_populated.remove(project))
+		return;
+
+	for(auto folder : project->workspace()->foldersForPath(IndexedString(project->path().pathOrUrl())))
+		folder->removeRows(0, folder->rowCount());
+}
+
+void CatkinManager::deferParsing(CatkinSubProject* project, const QUrl& url)
+{
+	if(!m_subProjects.contains(project) || project->isReady())
+		return;
+
+	// With flags from the last session or build the first parse is good
+	// enough, no need to parse again once the package is imported.
+	CatkinBuildInfo info;
+	if(provisionalBuildInfo(project, Path(url), &info))
 	{
-		auto items = (*it)->itemsForPath(indexedPath);
+		m_parsedProvisionally.insert(IndexedString(url));
+		return;
+	}
 
-		if(items.isEmpty())
+	// Without build information the parse would be redone anyway
+	core()->languageController()->backgroundParser()->removeDocument(IndexedString(url));
+}
+
+void CatkinManager::reparseOpenDocuments(CatkinSubProject* project)
+{
+	for(auto document : core()->documentController()->openDocuments())
+	{
+		if(!project->path().isParentOf(Path(document->url())))
+			continue;
+
+		if(m_parsedProvisionally.remove(IndexedString(document->url())))
+			continue;
+
+		core()->languageController()->backgroundParser()->addDocument(
+			IndexedString(document->url()),
+			TopDUContext::Features(TopDUContext::AllDeclarationsContextsAndUses | TopDUContext::ForceUpdate)
+		);
+	}
+}
+
+void CatkinManager::unloadIdleSubprojects()
+{
+	QSet<CatkinSubProject*> used;
+	for(auto document : core()->documentController()->openDocuments())
+	{
+		if(auto subProject = subprojectForPath(Path(document->url())))
+			used.insert(subProject);
+	}
+
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+	for(auto project : m_subProjects)
+	{
+		bool populated = m_populated.contains(project);
+		if((!project->isOpen() && !populated) || m_loading.contains(project) || used.contains(project))
+			continue;
+
+		KConfigGroup group(project->workspace()->projectConfiguration(), "Catkin");
+		bool lazy = group.readEntry("Lazy Loading", false);
+		if(!lazy && !populated)
+			continue;
+
+		qint64 timeout = 60 * 1000 * group.readEntry("Unload Timeout", 30);
+		if(timeout <= 0 || now - project->lastUsed() < timeout)
+			continue;
+
+		if(lazy && project->isOpen())
+		{
+			qDebug() << "Unloading idle package" << project->name();
+			project->unload();
+		}
+
+		// Back to the summary, i.e. the bare package folder
+		if(populated)
+			depopulateTree(project);
+	}
+
+	for(auto store : m_configStores)
+		store->sync();
+
+	for(auto workspace : m_lazyTree)
+		writeMemoryReport(workspace);
+}
+
+CatkinConfigStore* CatkinManager::configStore(KDevelop::IProject* workspace)
+{
+	CatkinConfigStore*& store = m_configStores[workspace];
+	if(!store)
+	{
+		Path developerDir(workspace->projectFile().parent(), ".kdev4");
+		QDir().mkpath(developerDir.toLocalFile());
+
+		store = new CatkinConfigStore(
+			Path(developerDir, workspace->name() + ".catkin").toLocalFile()
+		);
+	}
+
+	return store;
+}
+
+void CatkinManager::removeSubproject(CatkinSubProject* project)
+{
+	m_subProjects.removeOne(project);
+	m_pathIndex.remove(project->path());
+	m_buildInfoCache.invalidate(project);
+	m_cmakeCache.invalidate(project->buildPath());
+	m_loading.remove(project);
+	m_populated.remove(project);
+	project->disconnect(this);
+
+	{
+		QMutexLocker lock(&m_compileDatabaseMutex);
+		m_compileDatabases.remove(project);
+	}
+
+	project->unload();
+	project->deleteLater();
+}
+
+void CatkinManager::closeWorkspace(KDevelop::IProject* workspace)
+{
+	// Killed imports mark their packages failed, nothing to parse anymore
+	for(auto project : subprojects(workspace))
+		disconnect(project, &CatkinSubProject::stateChanged, this, nullptr);
+
+	// Don't wait for a running import, it is resumed on the next open
+	if(auto job = m_importJobs.take(workspace))
+		job->kill();
+
+	saveSnapshot(workspace);
+
+	{
+		QMutexLocker lock(&m_snapshotMutex);
+		m_snapshots.remove(workspace);
+	}
+
+	for(auto it = m_parsedProvisionally.begin(); it != m_parsedProvisionally.end();)
+	{
+		if(workspace->path().isParentOf(Path(it->toUrl())))
+			it = m_parsedProvisionally.erase(it);
+		else
+			++it;
+	}
+
+	for(auto project : subprojects(workspace))
+		removeSubproject(project);
+
+	for(const auto& path : m_watchedDirectories.take(workspace))
+		m_dirWatch.removeDir(path);
+
+	m_lazyTree.remove(workspace);
+
+	// Writes the configuration of the packages unloaded above
+	delete m_configStores.take(workspace);
+}
+
+void CatkinManager::writeMemoryReport(KDevelop::IProject* workspace)
+{
+	static const QString fileName = QString::fromLocal8Bit(qgetenv("KDEVCATKIN_MEMORY_REPORT"));
+	if(fileName.isEmpty())
+		return;
+
+	QVector<MemoryReportPackage> packages;
+	for(auto project : subprojects(workspace))
+	{
+		MemoryReportPackage package;
+		package.name = project->name();
+		package.path = project->path();
+		package.populated = !m_lazyTree.contains(workspace) || m_populated.contains(project);
+
+		for(auto folder : workspace->foldersForPath(IndexedString(project->path().pathOrUrl())))
+			package.tree.add(folder);
+
+		if(project->projectItem())
+			package.subProject.add(project->projectItem());
+
+		packages << package;
+	}
+
+	// Listing the packages which are not populated takes a while
+	const QString name = workspace->name();
+	ThreadWeaver::Queue::instance()->enqueue(ThreadWeaver::make_job([packages, name](){
+		QSaveFile file(fileName);
+		if(!file.open(QIODevice::WriteOnly))
+		{
+			qWarning() << "Could not write memory report" << fileName;
+			return;
+		}
+
+		QTextStream stream(&file);
+		stream << "# workspace " << name << ", resident set size " << residentSetSize() << " bytes\n";
+		stream << "# package\tpopulated\ttree items\ttree bytes\tsub-project items\tsub-project bytes\tfull tree items\tfull tree bytes\n";
+
+		ItemStatistics total;
+		ItemStatistics totalFull;
+
+		for(const auto& package : packages)
+		{
+			// What the tree would cost without lazy population
+			ItemStatistics full = package.populated ? package.tree : ItemStatistics::forDirectory(package.path);
+
+			stream << package.name << '\t' << (package.populated ? "yes" : "no")
+				<< '\t' << package.tree.items << '\t' << package.tree.bytes
+				<< '\t' << package.subProject.items << '\t' << package.subProject.bytes
+				<< '\t' << full.items << '\t' << full.bytes << '\n';
+
+			total.items += package.tree.items + package.subProject.items;
+			total.bytes += package.tree.bytes + package.subProject.bytes;
+			totalFull.items += full.items + package.subProject.items;
+			totalFull.bytes += full.bytes + package.subProject.bytes;
+		}
+
+		stream << "# total: " << total.bytes << " bytes, " << totalFull.bytes << " bytes fully populated\n";
+		stream.flush();
+
+		file.commit();
+	}));
+}
+
+QString CatkinManager::snapshotFileName(KDevelop::IProject* workspace)
+{
+	return Path(cacheDirectory(workspace), "session.snapshot").toLocalFile();
+}
+
+std::shared_ptr<const CatkinSessionSnapshot> CatkinManager::restoreSnapshot(KDevelop::IProject* workspace)
+{
+	KConfigGroup group(workspace->projectConfiguration(), "Catkin");
+	if(!group.readEntry("Session Snapshot", true))
+		return {};
+
+	auto snapshot = std::make_shared<CatkinSessionSnapshot>();
+	if(!snapshot->load(snapshotFileName(workspace), &m_buildInfoCache))
+		return {};
+
+	QMutexLocker lock(&m_snapshotMutex);
+	m_snapshots.insert(workspace, snapshot);
+
+	return snapshot;
+}
+
+void CatkinManager::saveSnapshot(KDevelop::IProject* workspace)
+{
+	KConfigGroup group(workspace->projectConfiguration(), "Catkin");
+	if(!group.readEntry("Session Snapshot", true))
+		return;
+
+	auto projects = subprojects(workspace);
+	if(projects.isEmpty())
+		return;
+
+	std::shared_ptr<const CatkinSessionSnapshot> previous;
+	{
+		QMutexLocker lock(&m_snapshotMutex);
+		previous = m_snapshots.value(workspace);
+	}
+
+	CatkinSessionSnapshot snapshot;
+	for(auto project : projects)
+	{
+		// Packages that were not imported this session keep their old entry
+		if(!project->isReady())
+		{
+			auto package = previous ? previous->package(project->path()) : nullptr;
+			if(package && package->name == project->name())
+				snapshot.addPackage(*previous, *package);
+			else
+				snapshot.addPackage(project->name(), project->path());
+			continue;
+		}
+
+		QHash<Path, CatkinBuildInfo> files;
+		for(const auto& file : project->fileSet())
+		{
+			auto items = project->filesForPath(file);
+			CatkinBuildInfo info;
+			if(!items.isEmpty() && importedBuildInfo(items.first(), &info))
+				files.insert(items.first()->path(), info);
+		}
+
+		snapshot.addPackage(project->name(), project->path(), files);
+	}
+
+	QDir().mkpath(cacheDirectory(workspace).toLocalFile());
+	if(!snapshot.save(snapshotFileName(workspace)))
+		qWarning() << "Could not write session snapshot for" << workspace->name();
+}
+
+void CatkinManager::watchDirectories(KDevelop::IProject* workspace, const QVector<CatkinPackageIndex::Directory>& directories)
+{
+	// Package directories and CATKIN_IGNOREd directories are watched as well,
+	// we are interested in package.xml and CATKIN_IGNORE appearing or going
+	// away. Directories inside packages are not.
+	auto& watched = m_watchedDirectories[workspace];
+	for(const auto& directory : directories)
+	{
+		QString path = QFile::decodeName(directory.path);
+		if(watched.contains(path))
+			continue;
+
+		watched.insert(path);
+		m_dirWatch.addDir(path);
+	}
+}
+
+void CatkinManager::rescanDirectories()
+{
+	QStringList dirty = m_dirtyDirectories.values();
+	m_dirtyDirectories.clear();
+
+	// Parents come first, changes below them are covered by their crawl
+	std::sort(dirty.begin(), dirty.end());
+
+	QString last;
+	for(const auto& path : dirty)
+	{
+		if(!last.isEmpty() && (path == last || path.startsWith(last + QLatin1Char('/'))))
+			continue;
+		last = path;
+
+		Path root(path);
+
+		IProject* workspace = nullptr;
+		for(auto it = m_watchedDirectories.begin(); it != m_watchedDirectories.end(); ++it)
 		{
-			qWarning() << "Got empty response from itemsForPath on" << indexedPath;
-			return AbstractFileManagerPlugin::createFileItem(project, path, parent);
+			if(it.value().contains(path))
+			{
+				workspace = it.key();
+				break;
+			}
 		}
+		if(!workspace)
+			continue;
+
+		auto crawler = new CatkinWorkspaceCrawler(this);
+		connect(crawler, &CatkinWorkspaceCrawler::finished, this, [this, crawler, workspace, root](){
+			// The workspace might have been closed in the meantime
+			if(m_watchedDirectories.contains(workspace))
+				updatePackages(workspace, root, crawler->takePackages(), crawler->takeDirectories());
+
+			crawler->deleteLater();
+		});
+		crawler->start(root);
+	}
+}
 
-		auto item = dynamic_cast<KDevelop::ProjectFileItem*>(items[0]);
-		if(!item)
+void CatkinManager::updatePackages(KDevelop::IProject* workspace, const KDevelop::Path& root,
+	const QVector<CatkinPackageIndex::Package>& packages,
+	const QVector<CatkinPackageIndex::Directory>& directories)
+{
+	watchDirectories(workspace, directories);
+
+	QHash<Path, QString> found;
+	for(const auto& package : packages)
+	{
+		if(!package.name.isEmpty())
+			found.insert(Path(QFile::decodeName(package.path)), package.name);
+	}
+
+	QVector<Path> changed;
+
+	// Only packages below root are affected, everything else stays loaded
+	for(auto project : subprojects(workspace))
+	{
+		if(project->path() != root && !root.isParentOf(project->path()))
+			continue;
+
+		if(found.remove(project->path()))
+			continue;
+
+		qDebug() << "Package" << project->name() << "disappeared";
+		changed << project->path();
+		removeSubproject(project);
+	}
+
+	KConfigGroup group(workspace->projectConfiguration(), "Catkin");
+	bool lazy = group.readEntry("Lazy Loading", false);
+
+	CatkinConfigStore* store = nullptr;
+	if(group.readEntry("Consolidated Configuration", false))
+		store = configStore(workspace);
+
+	for(auto it = found.begin(); it != found.end(); ++it)
+	{
+		auto project = createSubproject(workspace, it.value(), it.key(), store);
+		if(!project)
+			continue;
+
+		qDebug() << "Package" << project->name() << "appeared";
+		changed << project->path();
+
+		if(!lazy)
+			requestSubproject(project);
+	}
+
+	// The folder items have to change their type. They are replaced through
+	// createFolderItem(), only their own contents are listed again.
+	for(const auto& path : changed)
+	{
+		for(auto folder : workspace->foldersForPath(IndexedString(path.pathOrUrl())))
 		{
-			qWarning() << "Got invalid object type from itemsForPath";
-			return AbstractFileManagerPlugin::createFileItem(project, path, parent);
+			auto parent = folder->parent() ? folder->parent()->folder() : nullptr;
+			if(!parent)
+				continue;
+
+			delete folder;
+
+			// Gone with its package
+			if(!QFileInfo(path.toLocalFile()).isDir())
+				continue;
+
+			if(auto item = createFolderItem(workspace, path, parent))
+				AbstractFileManagerPlugin::reload(item);
 		}
+	}
+}
+
+CatkinSubProject* CatkinManager::subprojectForPath(const KDevelop::Path& path) const
+{
+	return m_pathIndex.find(path);
+}
 
-		return new SubProjectFile(project, path, item, parent);
+QList<CatkinSubProject*> CatkinManager::subprojects(KDevelop::IProject* workspace) const
+{
+	QList<CatkinSubProject*> projects;
+	for(auto project : m_subProjects)
+	{
+		if(project->workspace() == workspace)
+			projects << project;
 	}
+	return projects;
+}
+
+void CatkinManager::packageBuilt(CatkinSubProject* project)
+{
+	// The build rewrote compile_commands.json
+	QMutexLocker lock(&m_compileDatabaseMutex);
+	m_compileDatabases.remove(project);
+}
+
+QString CatkinManager::cmakeCacheValue(CatkinSubProject* project, const QByteArray& key) const
+{
+	return m_cmakeCache.value(project->buildPath(), key);
+}
+
+bool CatkinManager::usesMakefiles(CatkinSubProject* project) const
+{
+	return m_cmakeCache.usesMakefiles(project->buildPath());
+}
+
+KDevelop::ProjectFileItem* CatkinManager::createFileItem(KDevelop::IProject* project, const KDevelop::Path& path, KDevelop::ProjectBaseItem* parent)
+{
+	// Files of packages that are not loaded (yet) get a SubProjectFile as well,
+	// it resolves the sub-project item on demand.
+	if(auto subProject = subprojectForPath(path))
+		return new SubProjectFile(project, path, subProject, parent);
 
 	return AbstractFileManagerPlugin::createFileItem(project, path, parent);
 }
 
 KDevelop::ProjectFolderItem* CatkinManager::createFolderItem(KDevelop::IProject* project, const KDevelop::Path& path, KDevelop::ProjectBaseItem* parent)
 {
-	auto it = std::find_if(m_subProjects.begin(), m_subProjects.end(), [&](CatkinSubProject* subProj){
-		return subProj->path() == path;
-	});
-
-	if(it != m_subProjects.end())
-		return new SubProjectRoot(project, path, parent, *it);
+	if(auto subProject = m_pathIndex.findRoot(path))
+		return new SubProjectRoot(project, path, parent, subProject);
 
 	return AbstractFileManagerPlugin::createFolderItem(project, path, parent);
 }
 
 KDevelop::Path CatkinManager::compiler(KDevelop::ProjectTargetItem* p) const
 {
-	return {};
+	if(!p)
+		return {};
+
+	// Targets of a package folder know their package, anything else is
+	// looked up by path.
+	CatkinSubProject* subProject;
+	if(auto root = dynamic_cast<SubProjectRoot*>(p->parent()))
+		subProject = root->subProject();
+	else
+		subProject = subprojectForPath(p->path().parent());
+
+	if(!subProject)
+		return {};
+
+	return m_cmakeCache.compiler(subProject->buildPath());
 }
 
 #include "catkinmanager.moc"
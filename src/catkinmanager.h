@@ -10,11 +10,31 @@
 
 #include <project/projectmodel.h>
 
+#include <serialization/indexedstring.h>
+
 #include "catkinsubproject.h"
 #include "catkinbuildmanager.h"
+#include "catkinbuildinfocache.h"
+#include "catkincmakecache.h"
+#include "catkinpackageindex.h"
+#include "catkinpathindex.h"
+
+#include <KDirWatch>
+#include <KJob>
+
+#include <QHash>
+#include <QMutex>
+#include <QPointer>
+#include <QProcessEnvironment>
+#include <QSet>
+#include <QTimer>
 
 #include <memory>
 
+class CatkinCompileDatabase;
+class CatkinConfigStore;
+class CatkinSessionSnapshot;
+
 class CatkinManager
   : public KDevelop::AbstractFileManagerPlugin
   , public virtual KDevelop::IProjectFileManager
@@ -36,6 +56,8 @@ public:
 
 	virtual KDevelop::IProjectBuilder* builder() const override;
 
+	virtual KDevelop::ContextMenuExtension contextMenuExtension(KDevelop::Context* context, QWidget* parent) override;
+
 	virtual KDevelop::Path::List includeDirectories(KDevelop::ProjectBaseItem *item) const override;
 	virtual KDevelop::Path::List frameworkDirectories(KDevelop::ProjectBaseItem *item) const override;
 	virtual QHash<QString, QString> defines(KDevelop::ProjectBaseItem *item) const override;
@@ -58,19 +80,87 @@ public:
 
 	virtual bool hasBuildInfo(KDevelop::ProjectBaseItem* item) const override;
 
-	virtual KDevelop::Path buildDirectory(KDevelop::ProjectBaseItem*) const override;
+	virtual KDevelop::Path buildDirectory(KDevelop::ProjectBaseItem* item) const override;
+
+	/**
+	 * Creates and registers the sub-project for the package @p name in
+	 * @p sourcePath. Returns nullptr if the package has not been built yet.
+	 **/
+	CatkinSubProject* createSubproject(KDevelop::IProject* workspace, const QString& name,
+		const KDevelop::Path& sourcePath, CatkinConfigStore* configStore);
 
 	void addSubproject(CatkinSubProject* project);
 
+	//! Tears down @p project, it is deleted later
+	void removeSubproject(CatkinSubProject* project);
+
+	/**
+	 * Lists the contents of @p project in the workspace tree. With the
+	 * "Lazy Tree" setting, packages are only listed once they are used.
+	 **/
+	void populateTree(CatkinSubProject* project);
+
+	//! Loads the snapshot of the last session, nullptr if there is none
+	std::shared_ptr<const CatkinSessionSnapshot> restoreSnapshot(KDevelop::IProject* workspace);
+
+	//! Watches the crawled @p directories for packages coming and going
+	void watchDirectories(KDevelop::IProject* workspace, const QVector<CatkinPackageIndex::Directory>& directories);
+
+	//! Returns a job opening @p project and running its CMake import
+	KJob* loadSubproject(CatkinSubProject* project);
+
+	//! Consolidated sub-project configuration of @p workspace
+	CatkinConfigStore* configStore(KDevelop::IProject* workspace);
+
+	//! The sub-project containing @p path, nullptr if there is none
+	CatkinSubProject* subprojectForPath(const KDevelop::Path& path) const;
+
+	//! All sub-projects of @p workspace, loaded or not
+	QList<CatkinSubProject*> subprojects(KDevelop::IProject* workspace) const;
+
+	//! Called by the build jobs when @p project was built successfully
+	void packageBuilt(CatkinSubProject* project);
+
+	//! Value of the variable @p key in the CMakeCache.txt of @p project
+	QString cmakeCacheValue(CatkinSubProject* project, const QByteArray& key) const;
+
+	//! Whether @p project is configured with the Makefile generator, so it has /fast targets
+	bool usesMakefiles(CatkinSubProject* project) const;
+
+	//! The catkin build space of the workspace @p project
+	static KDevelop::Path buildSpace(KDevelop::IProject* project);
+
+	//! The merged catkin devel space of the workspace @p project
+	static KDevelop::Path develSpace(KDevelop::IProject* project);
+
+	//! The catkin install space of the workspace @p project
+	static KDevelop::Path installSpace(KDevelop::IProject* project);
+
+	//! Environment for build processes, packages find their dependencies in the devel space
+	static QProcessEnvironment buildEnvironment(KDevelop::IProject* project);
+
+	//! Directory for caches that belong to the workspace @p project
+	static KDevelop::Path cacheDirectory(KDevelop::IProject* project);
+
 	inline KDevelop::IProjectFileManager* cmakeManager()
 	{ return m_cmakeManager; }
 
 	inline KDevelop::IPlugin* cmakePlugin()
 	{ return m_cmakePlugin; }
 
+	/**
+	 * Imports the sub-projects with @p plugin instead of KDevCMakeManager,
+	 * e.g. a CatkinStubManager. Call before the first import.
+	 **/
+	void setCMakeManager(KDevelop::IPlugin* plugin);
+
+	//! Compiler of the package owning @p p
 	virtual KDevelop::Path compiler(KDevelop::ProjectTargetItem* p) const override;
 
 	bool reload(KDevelop::ProjectFolderItem * item) override;
+public Q_SLOTS:
+	//! Loads @p project in the background if it is not open yet
+	void requestSubproject(CatkinSubProject* project);
 protected:
 	virtual bool isValid(const KDevelop::Path& path, const bool isFolder, KDevelop::IProject* project) const override;
 
@@ -82,12 +172,83 @@ protected:
 		KDevelop::IProject* project, const KDevelop::Path& path,
 		KDevelop::ProjectBaseItem* parent) override;
 private:
+	//! Sub-project item for a file of the catkin project, triggers loading
+	KDevelop::ProjectFileItem* subProjectItem(KDevelop::ProjectBaseItem* item) const;
+
+	//! Cached build information for a file of the catkin project
+	bool buildInfo(KDevelop::ProjectBaseItem* item, CatkinBuildInfo* info) const;
+
+	//! Build information from the CMake import of @p subItem's sub-project
+	bool importedBuildInfo(KDevelop::ProjectFileItem* subItem, CatkinBuildInfo* info) const;
+
+	//! Build information from the session snapshot or compile_commands.json
+	bool provisionalBuildInfo(CatkinSubProject* project, const KDevelop::Path& file, CatkinBuildInfo* info) const;
+
+	//! compile_commands.json of the last build of @p project, loaded on first use
+	std::shared_ptr<const CatkinCompileDatabase> compileDatabase(CatkinSubProject* project) const;
+
+	//! Keeps @p url from being parsed twice while @p project is not ready
+	void deferParsing(CatkinSubProject* project, const QUrl& url);
+
+	//! Parses the open documents of @p project with its build information
+	void reparseOpenDocuments(CatkinSubProject* project);
+	void unloadIdleSubprojects();
+	void closeWorkspace(KDevelop::IProject* workspace);
+
+	//! Drops the listed contents of @p project again, see populateTree()
+	void depopulateTree(CatkinSubProject* project);
+
+	//! Per-package item counts and estimated memory, to KDEVCATKIN_MEMORY_REPORT
+	void writeMemoryReport(KDevelop::IProject* workspace);
+
+	static QString snapshotFileName(KDevelop::IProject* workspace);
+	void saveSnapshot(KDevelop::IProject* workspace);
+
+	//! Crawls the directories reported by the directory watch again
+	void rescanDirectories();
+
+	//! Adds and removes the sub-projects below @p root to match the crawl result
+	void updatePackages(KDevelop::IProject* workspace, const KDevelop::Path& root,
+		const QVector<CatkinPackageIndex::Package>& packages,
+		const QVector<CatkinPackageIndex::Directory>& directories);
+
 	std::shared_ptr<CatkinBuildManager> m_buildManager;
 	KDevelop::IPlugin* m_cmakePlugin = 0;
 	KDevelop::IProjectFileManager* m_cmakeManager = 0;
 
 	KDevelop::ProjectModel m_subProjectModel;
 	QList<CatkinSubProject*> m_subProjects;
+	CatkinPathIndex m_pathIndex;
+
+	mutable CatkinBuildInfoCache m_buildInfoCache;
+
+	mutable CatkinCMakeCache m_cmakeCache;
+
+	mutable QMutex m_compileDatabaseMutex;
+	mutable QHash<CatkinSubProject*, std::shared_ptr<const CatkinCompileDatabase>> m_compileDatabases;
+
+	QSet<CatkinSubProject*> m_loading;
+
+	//! Open documents that were parsed with provisional build information
+	QSet<KDevelop::IndexedString> m_parsedProvisionally;
+
+	mutable QMutex m_snapshotMutex;
+	QHash<KDevelop::IProject*, std::shared_ptr<const CatkinSessionSnapshot>> m_snapshots;
+	QHash<KDevelop::IProject*, CatkinConfigStore*> m_configStores;
+
+	//! Workspaces with lazily populated package folders
+	QSet<KDevelop::IProject*> m_lazyTree;
+	QSet<CatkinSubProject*> m_populated;
+
+	//! Running workspace imports
+	QHash<KDevelop::IProject*, QPointer<KJob>> m_importJobs;
+
+	QTimer m_unloadTimer;
+
+	KDirWatch m_dirWatch;
+	QHash<KDevelop::IProject*, QSet<QString>> m_watchedDirectories;
+	QSet<QString> m_dirtyDirectories;
+	QTimer m_rescanTimer;
 };
 
 #endif
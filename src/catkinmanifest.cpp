@@ -0,0 +1,134 @@
+// Streaming reader for catkin package manifests (package.xml)
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinmanifest.h"
+#include "catkintrace.h"
+
+#include <ThreadWeaver/ThreadWeaver>
+
+#include <QDebug>
+#include <QFile>
+#include <QXmlStreamReader>
+
+bool CatkinManifest::read(const QString& fileName, Fields fields)
+{
+	CatkinTrace::Span span("manifest", fileName);
+
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << "Could not open package XML" << fileName;
+		return false;
+	}
+
+	return read(&file, fileName, fields);
+}
+
+bool CatkinManifest::read(QIODevice* device, const QString& fileName, Fields fields)
+{
+	QXmlStreamReader xml(device);
+
+	if(!xml.readNextStartElement() || xml.name() != QLatin1String("package"))
+	{
+		qWarning() << "No <package> element found for package at" << fileName;
+		return false;
+	}
+
+	format = xml.attributes().value(QLatin1String("format")).toInt();
+	if(format == 0)
+		format = 1;
+
+	while(xml.readNextStartElement())
+	{
+		auto tag = xml.name();
+
+		if(tag == QLatin1String("name"))
+		{
+			name = xml.readElementText().trimmed();
+			if(fields == NameOnly)
+				return true;
+		}
+		else if(tag == QLatin1String("version"))
+			version = xml.readElementText().trimmed();
+		else if(tag == QLatin1String("depend"))
+		{
+			// format 2 shortcut for build, build_export and exec depends
+			QString dep = xml.readElementText().trimmed();
+			buildDepends << dep;
+			buildExportDepends << dep;
+			execDepends << dep;
+		}
+		else if(tag == QLatin1String("build_depend"))
+			buildDepends << xml.readElementText().trimmed();
+		else if(tag == QLatin1String("build_export_depend"))
+			buildExportDepends << xml.readElementText().trimmed();
+		else if(tag == QLatin1String("buildtool_depend") || tag == QLatin1String("buildtool_export_depend"))
+			buildtoolDepends << xml.readElementText().trimmed();
+		else if(tag == QLatin1String("exec_depend") || tag == QLatin1String("run_depend"))
+			execDepends << xml.readElementText().trimmed();
+		else if(tag == QLatin1String("test_depend"))
+			testDepends << xml.readElementText().trimmed();
+		else if(tag == QLatin1String("doc_depend"))
+			docDepends << xml.readElementText().trimmed();
+		else if(tag == QLatin1String("export"))
+		{
+			while(xml.readNextStartElement())
+			{
+				if(xml.name() == QLatin1String("build_type"))
+					buildType = xml.readElementText().trimmed();
+				else
+					xml.skipCurrentElement();
+			}
+		}
+		else
+			xml.skipCurrentElement();
+	}
+
+	if(xml.hasError())
+	{
+		qWarning("Could not parse package XML '%s':%d:%d: %s",
+			qPrintable(fileName),
+			int(xml.lineNumber()), int(xml.columnNumber()),
+			qPrintable(xml.errorString())
+		);
+		return false;
+	}
+
+	if(name.isEmpty())
+	{
+		qWarning() << "No <name> element found for package at" << fileName;
+		return false;
+	}
+
+	return true;
+}
+
+QVector<CatkinManifest> CatkinManifest::readAll(const QVector<QString>& fileNames, Fields fields)
+{
+	QVector<CatkinManifest> manifests(fileNames.size());
+
+	ThreadWeaver::Queue queue;
+	for(int i = 0; i < fileNames.size(); ++i)
+	{
+		CatkinManifest* manifest = &manifests[i];
+		QString fileName = fileNames[i];
+
+		queue.enqueue(ThreadWeaver::make_job([=](){
+			if(!manifest->read(fileName, fields))
+				*manifest = CatkinManifest();
+		}));
+	}
+
+	queue.finish();
+
+	return manifests;
+}
+
+QStringList CatkinManifest::allDependencies() const
+{
+	QStringList deps;
+	deps << buildDepends << buildExportDepends << buildtoolDepends
+		<< execDepends << testDepends << docDepends;
+	deps.removeDuplicates();
+	return deps;
+}
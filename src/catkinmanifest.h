@@ -0,0 +1,51 @@
+// Streaming reader for catkin package manifests (package.xml)
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINMANIFEST_H
+#define CATKINMANIFEST_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QIODevice;
+
+/**
+ * The parts of a package.xml we are interested in.
+ *
+ * The manifest is read with QXmlStreamReader in a single pass. If only the
+ * package name is requested, reading stops right after the <name> element,
+ * which is usually among the first few lines of the file.
+ **/
+class CatkinManifest
+{
+public:
+	enum Fields
+	{
+		NameOnly,
+		AllFields
+	};
+
+	bool read(const QString& fileName, Fields fields = AllFields);
+	bool read(QIODevice* device, const QString& fileName, Fields fields = AllFields);
+
+	//! Reads all @p fileNames in parallel, failed manifests have an empty name
+	static QVector<CatkinManifest> readAll(const QVector<QString>& fileNames, Fields fields = AllFields);
+
+	//! All packages this package depends on, in any way
+	QStringList allDependencies() const;
+
+	QString name;
+	QString version;
+	int format = 1;
+	QString buildType = QStringLiteral("catkin");
+
+	QStringList buildDepends;
+	QStringList buildExportDepends;
+	QStringList buildtoolDepends;
+	QStringList execDepends;
+	QStringList testDepends;
+	QStringList docDepends;
+};
+
+#endif
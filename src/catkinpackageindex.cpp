@@ -0,0 +1,306 @@
+// Persistent, memory-mapped index of the packages in a catkin workspace
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinpackageindex.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QSet>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+	const char MAGIC[8] = {'K', 'D', 'E', 'V', 'C', 'K', 'I', 'X'};
+	const quint32 VERSION = 2;
+	const quint32 NONE = 0xFFFFFFFF;
+
+	qint64 align(qint64 offset)
+	{
+		return (offset + 7) & ~qint64(7);
+	}
+}
+
+struct CatkinPackageIndex::Header
+{
+	char magic[8];
+	quint32 version;
+	quint32 directoryCount;
+	quint32 childCount;
+	quint32 packageCount;
+	quint32 stringSize;
+	quint32 reserved;
+};
+
+struct CatkinPackageIndex::DirectoryRecord
+{
+	qint64 mtime;
+	quint32 path;
+	quint32 pathLength;
+	quint32 flags;
+	quint32 firstChild;
+	quint32 childCount;
+	quint32 package;
+};
+
+struct CatkinPackageIndex::PackageRecord
+{
+	qint64 manifestMTime;
+	qint64 manifestSize;
+	quint32 directory;
+	quint32 name;
+	quint32 nameLength;
+	quint32 buildPath;
+	quint32 buildPathLength;
+	quint32 reserved;
+};
+
+CatkinPackageIndex::CatkinPackageIndex()
+{
+}
+
+CatkinPackageIndex::~CatkinPackageIndex()
+{
+}
+
+bool CatkinPackageIndex::load(const QString& fileName)
+{
+	m_file.setFileName(fileName);
+	if(!m_file.open(QIODevice::ReadOnly))
+		return false;
+
+	m_size = m_file.size();
+	if(m_size < qint64(sizeof(Header)))
+		return false;
+
+	m_data = m_file.map(0, m_size);
+	if(!m_data)
+		return false;
+
+	const Header* h = header();
+	qint64 expectedSize = align(
+		sizeof(Header)
+		+ qint64(h->directoryCount) * sizeof(DirectoryRecord)
+		+ qint64(h->childCount) * sizeof(quint32)
+	) + qint64(h->packageCount) * sizeof(PackageRecord) + h->stringSize;
+
+	if(memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 || h->version != VERSION || expectedSize != m_size)
+	{
+		qWarning() << "Ignoring invalid package index" << fileName;
+		m_file.unmap(const_cast<uchar*>(m_data));
+		m_data = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+const CatkinPackageIndex::Header* CatkinPackageIndex::header() const
+{
+	return reinterpret_cast<const Header*>(m_data);
+}
+
+const CatkinPackageIndex::DirectoryRecord* CatkinPackageIndex::directoryRecord(int directory) const
+{
+	return reinterpret_cast<const DirectoryRecord*>(m_data + sizeof(Header)) + directory;
+}
+
+QByteArray CatkinPackageIndex::string(quint32 offset, quint32 length) const
+{
+	const char* strings = reinterpret_cast<const char*>(m_data) + m_size - header()->stringSize;
+	return QByteArray(strings + offset, length);
+}
+
+int CatkinPackageIndex::findDirectory(const QByteArray& path) const
+{
+	if(!m_data)
+		return -1;
+
+	const char* strings = reinterpret_cast<const char*>(m_data) + m_size - header()->stringSize;
+	const DirectoryRecord* begin = directoryRecord(0);
+	const DirectoryRecord* end = begin + header()->directoryCount;
+
+	auto it = std::lower_bound(begin, end, path, [&](const DirectoryRecord& record, const QByteArray& path){
+		int cmp = memcmp(strings + record.path, path.constData(), std::min<int>(record.pathLength, path.size()));
+		if(cmp != 0)
+			return cmp < 0;
+		return int(record.pathLength) < path.size();
+	});
+
+	if(it == end || int(it->pathLength) != path.size()
+		|| memcmp(strings + it->path, path.constData(), path.size()) != 0)
+	{
+		return -1;
+	}
+
+	return it - begin;
+}
+
+qint64 CatkinPackageIndex::directoryMTime(int directory) const
+{
+	return directoryRecord(directory)->mtime;
+}
+
+quint32 CatkinPackageIndex::directoryFlags(int directory) const
+{
+	return directoryRecord(directory)->flags;
+}
+
+QVector<QByteArray> CatkinPackageIndex::directoryChildren(int directory) const
+{
+	const DirectoryRecord* record = directoryRecord(directory);
+	const quint32* children = reinterpret_cast<const quint32*>(directoryRecord(header()->directoryCount));
+
+	QVector<QByteArray> ret;
+	ret.reserve(record->childCount);
+	for(quint32 i = 0; i < record->childCount; ++i)
+	{
+		const DirectoryRecord* child = directoryRecord(children[record->firstChild + i]);
+		ret << string(child->path, child->pathLength);
+	}
+
+	return ret;
+}
+
+bool CatkinPackageIndex::package(int directory, Package* package) const
+{
+	const DirectoryRecord* dirRecord = directoryRecord(directory);
+	if(dirRecord->package == NONE)
+		return false;
+
+	const Header* h = header();
+	qint64 offset = align(
+		sizeof(Header)
+		+ qint64(h->directoryCount) * sizeof(DirectoryRecord)
+		+ qint64(h->childCount) * sizeof(quint32)
+	);
+	const PackageRecord* record = reinterpret_cast<const PackageRecord*>(m_data + offset) + dirRecord->package;
+
+	package->path = string(dirRecord->path, dirRecord->pathLength);
+	package->name = QString::fromUtf8(string(record->name, record->nameLength));
+	package->buildPath = string(record->buildPath, record->buildPathLength);
+	package->manifestMTime = record->manifestMTime;
+	package->manifestSize = record->manifestSize;
+
+	return true;
+}
+
+bool CatkinPackageIndex::save(const QString& fileName,
+	QVector<Directory> directories, const QVector<Package>& packages)
+{
+	// Children the crawl did not get to (it was cancelled, or they are
+	// symlinks into visited directories) are stored with an mtime that never
+	// matches, so the next crawl visits and reads them.
+	QSet<QByteArray> visited;
+	visited.reserve(directories.size());
+	for(const auto& dir : directories)
+		visited.insert(dir.path);
+
+	const int visitedCount = directories.size();
+	for(int i = 0; i < visitedCount; ++i)
+	{
+		// Copy, the placeholders reallocate the vector
+		const QVector<QByteArray> children = directories[i].children;
+		for(const auto& child : children)
+		{
+			if(visited.contains(child))
+				continue;
+
+			Directory placeholder;
+			placeholder.path = child;
+			directories << placeholder;
+			visited.insert(child);
+		}
+	}
+
+	std::sort(directories.begin(), directories.end(), [](const Directory& a, const Directory& b){
+		return a.path < b.path;
+	});
+
+	QHash<QByteArray, quint32> directoryIndex;
+	directoryIndex.reserve(directories.size());
+	for(int i = 0; i < directories.size(); ++i)
+		directoryIndex.insert(directories[i].path, i);
+
+	QByteArray strings;
+	auto addString = [&](const QByteArray& str){
+		quint32 offset = strings.size();
+		strings.append(str);
+		return offset;
+	};
+
+	QVector<DirectoryRecord> directoryRecords(directories.size());
+	QVector<quint32> children;
+
+	for(int i = 0; i < directories.size(); ++i)
+	{
+		const Directory& dir = directories[i];
+		DirectoryRecord& record = directoryRecords[i];
+
+		record.mtime = dir.mtime;
+		record.path = addString(dir.path);
+		record.pathLength = dir.path.size();
+		record.flags = dir.flags;
+		record.firstChild = children.size();
+		record.package = NONE;
+
+		for(const auto& child : dir.children)
+			children << directoryIndex.value(child);
+
+		record.childCount = children.size() - record.firstChild;
+	}
+
+	QVector<PackageRecord> packageRecords;
+	packageRecords.reserve(packages.size());
+
+	for(const auto& package : packages)
+	{
+		auto it = directoryIndex.constFind(package.path);
+		if(it == directoryIndex.constEnd())
+			continue;
+
+		QByteArray name = package.name.toUtf8();
+
+		PackageRecord record;
+		memset(&record, 0, sizeof(record));
+		record.manifestMTime = package.manifestMTime;
+		record.manifestSize = package.manifestSize;
+		record.directory = *it;
+		record.name = addString(name);
+		record.nameLength = name.size();
+		record.buildPath = addString(package.buildPath);
+		record.buildPathLength = package.buildPath.size();
+
+		directoryRecords[*it].package = packageRecords.size();
+		packageRecords << record;
+	}
+
+	Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.version = VERSION;
+	h.directoryCount = directoryRecords.size();
+	h.childCount = children.size();
+	h.packageCount = packageRecords.size();
+	h.stringSize = strings.size();
+
+	QByteArray data;
+	data.append(reinterpret_cast<const char*>(&h), sizeof(h));
+	data.append(reinterpret_cast<const char*>(directoryRecords.constData()), directoryRecords.size() * sizeof(DirectoryRecord));
+	data.append(reinterpret_cast<const char*>(children.constData()), children.size() * sizeof(quint32));
+	data.append(QByteArray(align(data.size()) - data.size(), '\0'));
+	data.append(reinterpret_cast<const char*>(packageRecords.constData()), packageRecords.size() * sizeof(PackageRecord));
+	data.append(strings);
+
+	QSaveFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly))
+	{
+		qWarning() << "Could not write package index" << fileName;
+		return false;
+	}
+
+	file.write(data);
+	return file.commit();
+}
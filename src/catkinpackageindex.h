@@ -0,0 +1,84 @@
+// Persistent, memory-mapped index of the packages in a catkin workspace
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINPACKAGEINDEX_H
+#define CATKINPACKAGEINDEX_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+/**
+ * On-disk result of a workspace crawl.
+ *
+ * The file consists of a fixed header, a directory table sorted by path,
+ * a child table, a package table and a string blob. All paths are stored
+ * in the local 8-bit encoding the crawler works with, so lookups are plain
+ * binary searches on the mapped file without any allocation.
+ *
+ * A directory entry is valid as long as the directory's mtime did not change,
+ * a package entry as long as mtime and size of its package.xml match.
+ * Directories listed as children but never visited are stored with mtime 0,
+ * so an index of a cancelled crawl is as good as its visited part.
+ **/
+class CatkinPackageIndex
+{
+public:
+	enum DirectoryFlag
+	{
+		IsPackage = 1,
+		IsIgnored = 2
+	};
+
+	struct Directory
+	{
+		QByteArray path;
+		qint64 mtime = 0;
+		quint32 flags = 0;
+		QVector<QByteArray> children;
+	};
+
+	struct Package
+	{
+		QByteArray path;
+		QString name;
+		QByteArray buildPath;
+		qint64 manifestMTime = 0;
+		qint64 manifestSize = 0;
+	};
+
+	CatkinPackageIndex();
+	~CatkinPackageIndex();
+
+	bool load(const QString& fileName);
+	bool isValid() const
+	{ return m_data != nullptr; }
+
+	static bool save(const QString& fileName,
+		QVector<Directory> directories, const QVector<Package>& packages);
+
+	//! @return index of the directory entry or -1
+	int findDirectory(const QByteArray& path) const;
+
+	qint64 directoryMTime(int directory) const;
+	quint32 directoryFlags(int directory) const;
+	QVector<QByteArray> directoryChildren(int directory) const;
+
+	//! Package found in @p directory during the last crawl
+	bool package(int directory, Package* package) const;
+private:
+	struct Header;
+	struct DirectoryRecord;
+	struct PackageRecord;
+
+	const Header* header() const;
+	const DirectoryRecord* directoryRecord(int directory) const;
+	QByteArray string(quint32 offset, quint32 length) const;
+
+	QFile m_file;
+	const uchar* m_data = nullptr;
+	qint64 m_size = 0;
+};
+
+#endif
@@ -0,0 +1,101 @@
+// Prefix trie mapping paths to the sub-project owning them
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinpathindex.h"
+
+#include <QVector>
+
+CatkinPathIndex::Node::~Node()
+{
+	qDeleteAll(children);
+}
+
+CatkinPathIndex::CatkinPathIndex()
+{
+}
+
+CatkinPathIndex::~CatkinPathIndex()
+{
+}
+
+void CatkinPathIndex::insert(const KDevelop::Path& root, CatkinSubProject* project)
+{
+	QWriteLocker lock(&m_lock);
+
+	Node* node = &m_root;
+	for(const QString& segment : root.segments())
+	{
+		Node*& child = node->children[segment];
+		if(!child)
+			child = new Node;
+		node = child;
+	}
+
+	node->project = project;
+}
+
+void CatkinPathIndex::remove(const KDevelop::Path& root)
+{
+	const auto segments = root.segments();
+
+	QWriteLocker lock(&m_lock);
+
+	// Remember the path down, so we can prune empty nodes afterwards
+	QVector<Node*> nodes;
+	nodes.reserve(segments.size() + 1);
+	nodes << &m_root;
+
+	for(const QString& segment : segments)
+	{
+		Node* child = nodes.last()->children.value(segment);
+		if(!child)
+			return;
+		nodes << child;
+	}
+
+	nodes.last()->project = nullptr;
+
+	for(int i = segments.size(); i > 0; --i)
+	{
+		Node* node = nodes[i];
+		if(node->project || !node->children.isEmpty())
+			break;
+
+		nodes[i-1]->children.remove(segments[i-1]);
+		delete node;
+	}
+}
+
+CatkinSubProject* CatkinPathIndex::find(const KDevelop::Path& path) const
+{
+	QReadLocker lock(&m_lock);
+
+	const Node* node = &m_root;
+	for(const QString& segment : path.segments())
+	{
+		// catkin packages cannot be nested, so the first hit is the owner
+		if(node->project)
+			return node->project;
+
+		node = node->children.value(segment);
+		if(!node)
+			return nullptr;
+	}
+
+	return node->project;
+}
+
+CatkinSubProject* CatkinPathIndex::findRoot(const KDevelop::Path& path) const
+{
+	QReadLocker lock(&m_lock);
+
+	const Node* node = &m_root;
+	for(const QString& segment : path.segments())
+	{
+		node = node->children.value(segment);
+		if(!node)
+			return nullptr;
+	}
+
+	return node->project;
+}
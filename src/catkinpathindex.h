@@ -0,0 +1,55 @@
+// Prefix trie mapping paths to the sub-project owning them
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINPATHINDEX_H
+#define CATKINPATHINDEX_H
+
+#include <util/path.h>
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+
+class CatkinSubProject;
+
+/**
+ * Trie over the path segments of the sub-project root directories.
+ *
+ * Finding the sub-project a file or folder belongs to walks the segments of
+ * its path once, so the cost depends on the path depth only and not on the
+ * number of packages in the workspace.
+ *
+ * Thread-safe, the parse jobs look up paths while the main thread adds and
+ * removes sub-projects.
+ **/
+class CatkinPathIndex
+{
+public:
+	CatkinPathIndex();
+	~CatkinPathIndex();
+
+	CatkinPathIndex(const CatkinPathIndex&) = delete;
+	CatkinPathIndex& operator=(const CatkinPathIndex&) = delete;
+
+	void insert(const KDevelop::Path& root, CatkinSubProject* project);
+	void remove(const KDevelop::Path& root);
+
+	//! Sub-project whose root is @p path or one of its parents
+	CatkinSubProject* find(const KDevelop::Path& path) const;
+
+	//! Sub-project whose root is exactly @p path
+	CatkinSubProject* findRoot(const KDevelop::Path& path) const;
+private:
+	struct Node
+	{
+		~Node();
+
+		QHash<QString, Node*> children;
+		CatkinSubProject* project = nullptr;
+	};
+
+	mutable QReadWriteLock m_lock;
+	Node m_root;
+};
+
+#endif
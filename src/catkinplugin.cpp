@@ -0,0 +1,10 @@
+// Plugin factory of the catkin project manager
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinmanager.h"
+
+#include <KPluginFactory>
+
+K_PLUGIN_FACTORY_WITH_JSON(CatkinManagerFactory, "kdevcatkin.json", registerPlugin<CatkinManager>(); )
+
+#include "catkinplugin.moc"
@@ -0,0 +1,310 @@
+// Computes which packages of a catkin workspace actually need building
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinrebuildset.h"
+#include "catkindependencygraph.h"
+#include "catkinsubproject.h"
+
+#include <ThreadWeaver/ThreadWeaver>
+
+#include <KLocalizedString>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
+#include <QMap>
+#include <QPair>
+#include <QSaveFile>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace
+{
+	const quint32 SOURCES_VERSION = 1;
+
+	struct FileState
+	{
+		qint64 mtime;
+		qint64 size;
+		QByteArray hash;
+	};
+
+	QDataStream& operator<<(QDataStream& stream, const FileState& state)
+	{
+		return stream << state.mtime << state.size << state.hash;
+	}
+
+	QDataStream& operator>>(QDataStream& stream, FileState& state)
+	{
+		return stream >> state.mtime >> state.size >> state.hash;
+	}
+
+	QString sourcesFile(const KDevelop::Path& buildPath)
+	{
+		return KDevelop::Path(buildPath, ".kdevcatkin-sources").toLocalFile();
+	}
+
+	QString stampFile(const KDevelop::Path& buildPath, CatkinRebuildSet::Stamp stamp)
+	{
+		return KDevelop::Path(buildPath,
+			stamp == CatkinRebuildSet::Built ? ".kdevcatkin-built" : ".kdevcatkin-tested"
+		).toLocalFile();
+	}
+
+	QByteArray hashFile(const QByteArray& fileName)
+	{
+		QFile file(QFile::decodeName(fileName));
+		if(!file.open(QIODevice::ReadOnly))
+			return QByteArray();
+
+		QCryptographicHash hash(QCryptographicHash::Sha1);
+		hash.addData(&file);
+		return hash.result();
+	}
+
+	struct Digest
+	{
+		QByteArray digest;
+		QString changedFile;
+	};
+
+	/**
+	 * Hashes the sources of a package, re-reading only files whose mtime
+	 * or size changed since the last run. With @p save, the new file
+	 * states are recorded for the next run.
+	 **/
+	Digest computeDigest(const KDevelop::Path& sourcePath, const KDevelop::Path& buildPath, bool save = true)
+	{
+		QHash<QByteArray, FileState> previous;
+		{
+			QFile file(sourcesFile(buildPath));
+			if(file.open(QIODevice::ReadOnly))
+			{
+				QDataStream stream(&file);
+				quint32 version = 0;
+				stream >> version;
+				if(version == SOURCES_VERSION)
+					stream >> previous;
+			}
+		}
+
+		const QByteArray root = QFile::encodeName(sourcePath.toLocalFile());
+
+		// Sorted, so the digest does not depend on the readdir() order
+		QMap<QByteArray, FileState> current;
+		QString changedFile;
+
+		// Symlinks are followed, so directories are identified by device/inode
+		// to hash each one once and to stop at symlink loops
+		QSet<QPair<quint64, quint64>> visited;
+		struct stat rootStat;
+		if(stat(root.constData(), &rootStat) == 0)
+			visited.insert(qMakePair<quint64, quint64>(rootStat.st_dev, rootStat.st_ino));
+
+		QVector<QByteArray> stack{QByteArray()};
+		while(!stack.isEmpty())
+		{
+			QByteArray relative = stack.takeLast();
+			DIR* dir = opendir(relative.isEmpty() ? root.constData() : (root + '/' + relative).constData());
+			if(!dir)
+				continue;
+
+			while(dirent* entry = readdir(dir))
+			{
+				const char* name = entry->d_name;
+
+				// Hidden files, VCS metadata, . and ..
+				if(name[0] == '.')
+					continue;
+
+				QByteArray childRelative = relative.isEmpty() ? QByteArray(name) : relative + '/' + name;
+
+				struct stat st;
+				if(fstatat(dirfd(dir), name, &st, 0) != 0)
+					continue;
+
+				if(S_ISDIR(st.st_mode))
+				{
+					auto id = qMakePair<quint64, quint64>(st.st_dev, st.st_ino);
+					if(!visited.contains(id))
+					{
+						visited.insert(id);
+						stack << childRelative;
+					}
+					continue;
+				}
+
+				if(!S_ISREG(st.st_mode))
+					continue;
+
+				FileState state;
+				state.mtime = st.st_mtim.tv_sec * Q_INT64_C(1000000000) + st.st_mtim.tv_nsec;
+				state.size = st.st_size;
+
+				auto it = previous.constFind(childRelative);
+				if(it != previous.constEnd() && it->mtime == state.mtime && it->size == state.size)
+					state.hash = it->hash;
+				else
+					state.hash = hashFile(root + '/' + childRelative);
+
+				if((it == previous.constEnd() || it->hash != state.hash) && changedFile.isEmpty())
+					changedFile = QFile::decodeName(childRelative);
+
+				current.insert(childRelative, state);
+			}
+
+			closedir(dir);
+		}
+
+		if(changedFile.isEmpty() && previous.size() != current.size())
+			changedFile = i18n("(removed files)");
+
+		QCryptographicHash hash(QCryptographicHash::Sha1);
+		for(auto it = current.constBegin(); it != current.constEnd(); ++it)
+		{
+			hash.addData(it.key());
+			hash.addData("\0", 1);
+			hash.addData(it->hash);
+		}
+
+		// Only write the state if something changed
+		if(save && !changedFile.isEmpty())
+		{
+			QSaveFile file(sourcesFile(buildPath));
+			if(file.open(QIODevice::WriteOnly))
+			{
+				QDataStream stream(&file);
+				stream << SOURCES_VERSION;
+
+				QHash<QByteArray, FileState> states;
+				states.reserve(current.size());
+				for(auto it = current.constBegin(); it != current.constEnd(); ++it)
+					states.insert(it.key(), *it);
+				stream << states;
+
+				file.commit();
+			}
+		}
+
+		return {hash.result(), changedFile};
+	}
+}
+
+CatkinRebuildSet::CatkinRebuildSet(const CatkinDependencyGraph& graph, const QSet<QString>& selection, Stamp stamp, bool dryRun)
+ : m_stamp(stamp)
+{
+	struct Result
+	{
+		QString name;
+		Package package;
+		bool configured = false;
+		QString changedFile;
+		QByteArray built;
+	};
+
+	QVector<Result> results;
+	results.reserve(selection.size());
+	for(const QString& name : selection)
+	{
+		Result result;
+		result.name = name;
+		result.package.sourcePath = graph.path(name);
+		result.package.buildPath = graph.buildPath(name);
+		results << result;
+	}
+
+	// Hash the packages in parallel
+	ThreadWeaver::Queue queue;
+	for(Result& result : results)
+	{
+		Result* r = &result;
+
+		queue.enqueue(ThreadWeaver::make_job([r, stamp, dryRun](){
+			r->configured = QFile::exists(KDevelop::Path(r->package.buildPath, "CMakeCache.txt").toLocalFile());
+			if(!r->configured)
+				return;
+
+			Digest digest = computeDigest(r->package.sourcePath, r->package.buildPath, !dryRun);
+			r->package.digest = digest.digest;
+			r->changedFile = digest.changedFile;
+
+			QFile file(stampFile(r->package.buildPath, stamp));
+			if(file.open(QIODevice::ReadOnly))
+				r->built = file.readAll();
+		}));
+	}
+	queue.finish();
+
+	QStringList rebuilt;
+	for(const Result& result : results)
+	{
+		m_packages.insert(result.name, result.package);
+
+		if(!result.configured)
+			m_entries << Entry{result.name, NotConfigured, QString()};
+		else if(result.built.isEmpty())
+			m_entries << Entry{result.name, NeverBuilt, QString()};
+		else if(result.package.digest != result.built)
+			m_entries << Entry{result.name, SourcesChanged, result.changedFile};
+		else
+			continue;
+
+		rebuilt << result.name;
+		m_reasons.insert(result.name, m_entries.size() - 1);
+	}
+
+	// Everything depending on a rebuilt package has to be rebuilt as well
+	while(!rebuilt.isEmpty())
+	{
+		QString name = rebuilt.takeFirst();
+		for(const QString& dependent : graph.dependents(name))
+		{
+			if(!selection.contains(dependent) || m_reasons.contains(dependent))
+				continue;
+
+			m_entries << Entry{dependent, DependencyRebuilt, name};
+			m_reasons.insert(dependent, m_entries.size() - 1);
+			rebuilt << dependent;
+		}
+	}
+}
+
+void CatkinRebuildSet::markDone(const QString& package) const
+{
+	auto it = m_packages.constFind(package);
+	if(it == m_packages.constEnd())
+		return;
+
+	// A package configured by this build was not hashed yet. Called in a
+	// worker thread, like the construction.
+	QByteArray digest = it->digest;
+	if(digest.isEmpty())
+		digest = computeDigest(it->sourcePath, it->buildPath).digest;
+
+	QSaveFile file(stampFile(it->buildPath, m_stamp));
+	if(!file.open(QIODevice::WriteOnly))
+		return;
+
+	file.write(digest);
+	file.commit();
+}
+
+QString CatkinRebuildSet::reasonText(const Entry& entry) const
+{
+	switch(entry.reason)
+	{
+		case NotConfigured:
+			return i18n("not configured yet");
+		case NeverBuilt:
+			return m_stamp == Built ? i18n("never built") : i18n("never tested");
+		case SourcesChanged:
+			if(entry.detail.isEmpty())
+				return m_stamp == Built ? i18n("sources changed since the last build") : i18n("sources changed since the last test run");
+			return i18n("sources changed (%1)", entry.detail);
+		case DependencyRebuilt:
+			return i18n("dependency %1 is rebuilt", entry.detail);
+	}
+
+	return QString();
+}
@@ -0,0 +1,91 @@
+// Computes which packages of a catkin workspace actually need building
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINREBUILDSET_H
+#define CATKINREBUILDSET_H
+
+#include <util/path.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+class CatkinDependencyGraph;
+
+/**
+ * The minimal set of packages to build.
+ *
+ * Each package gets a content hash over its source files. The per-file
+ * hashes are kept in the package build directory along with mtime and size,
+ * so only modified files are read again. A package needs building if it
+ * was never configured, if its hash differs from the one recorded by the
+ * last successful build (see markDone()), or if one of its dependencies
+ * is rebuilt. The same works for test runs, with a separate stamp.
+ *
+ * Computing the set reads all sources, it is meant to run in a worker
+ * thread. The graph only has to stay alive during construction.
+ **/
+class CatkinRebuildSet
+{
+public:
+	enum Reason
+	{
+		NotConfigured,
+		NeverBuilt,
+		SourcesChanged,
+		DependencyRebuilt
+	};
+
+	struct Entry
+	{
+		QString package;
+		Reason reason;
+
+		//! The first changed file (if known) or the rebuilt dependency
+		QString detail;
+	};
+
+	//! What a package was last done with successfully
+	enum Stamp
+	{
+		Built,
+		Tested
+	};
+
+	/**
+	 * Computes the set for the packages @p selection of @p graph. With
+	 * @p dryRun, the file hashes are not recorded in the build directories.
+	 **/
+	CatkinRebuildSet(const CatkinDependencyGraph& graph, const QSet<QString>& selection, Stamp stamp = Built, bool dryRun = false);
+
+	QVector<Entry> entries() const
+	{ return m_entries; }
+
+	bool contains(const QString& package) const
+	{ return m_reasons.contains(package); }
+
+	/**
+	 * Records that @p package was built (or tested) with the sources hashed
+	 * by this set. Might have to hash the sources, run it in a worker thread.
+	 **/
+	void markDone(const QString& package) const;
+
+	QString reasonText(const Entry& entry) const;
+private:
+	struct Package
+	{
+		KDevelop::Path sourcePath;
+		KDevelop::Path buildPath;
+		QByteArray digest;
+	};
+
+	Stamp m_stamp;
+
+	QVector<Entry> m_entries;
+	QHash<QString, int> m_reasons;
+	QHash<QString, Package> m_packages;
+};
+
+#endif
@@ -0,0 +1,210 @@
+// Snapshot of the sub-projects and their build information between sessions
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinsessionsnapshot.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+
+#include <algorithm>
+
+namespace
+{
+	const quint32 MAGIC = 0x4b43534e; // KCSN
+	const quint32 VERSION = 2;
+
+	void writePaths(QDataStream& stream, const KDevelop::Path::List& paths)
+	{
+		stream << quint32(paths.size());
+		for(const auto& path : paths)
+			stream << path.pathOrUrl();
+	}
+
+	KDevelop::Path::List readPaths(QDataStream& stream)
+	{
+		quint32 count = 0;
+		stream >> count;
+
+		KDevelop::Path::List paths;
+		for(quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+		{
+			QString path;
+			stream >> path;
+			paths << KDevelop::Path(path);
+		}
+		return paths;
+	}
+}
+
+bool CatkinSessionSnapshot::load(const QString& fileName, CatkinBuildInfoCache* cache)
+{
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_6);
+
+	quint32 magic = 0;
+	quint32 version = 0;
+	stream >> magic >> version;
+	if(magic != MAGIC || version != VERSION)
+		return false;
+
+	quint32 infoCount = 0;
+	stream >> infoCount;
+	for(quint32 i = 0; i < infoCount && stream.status() == QDataStream::Ok; ++i)
+	{
+		CatkinBuildInfo info;
+		info.includeDirectories = readPaths(stream);
+		info.frameworkDirectories = readPaths(stream);
+		stream >> info.defines >> info.extraArguments;
+
+		if(cache)
+			info = cache->intern(info);
+
+		m_infoIndex.insert(info, m_infos.size());
+		m_infos << info;
+	}
+
+	quint32 packageCount = 0;
+	stream >> packageCount;
+	for(quint32 i = 0; i < packageCount && stream.status() == QDataStream::Ok; ++i)
+	{
+		Package package;
+		QString path;
+		stream >> package.name >> path >> package.files >> package.imported;
+		package.path = KDevelop::Path(path);
+
+		m_packageIndex.insert(package.path, m_packages.size());
+		m_packages << package;
+	}
+
+	if(stream.status() != QDataStream::Ok)
+	{
+		qWarning() << "Could not read session snapshot" << fileName;
+		*this = CatkinSessionSnapshot();
+		return false;
+	}
+
+	// Don't trust indices from a damaged file
+	for(const auto& package : m_packages)
+	{
+		for(int index : package.files)
+		{
+			if(index < 0 || index >= m_infos.size())
+			{
+				qWarning() << "Invalid session snapshot" << fileName;
+				*this = CatkinSessionSnapshot();
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool CatkinSessionSnapshot::save(const QString& fileName) const
+{
+	QSaveFile file(fileName);
+	if(!file.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_6);
+
+	stream << MAGIC << VERSION;
+
+	stream << quint32(m_infos.size());
+	for(const auto& info : m_infos)
+	{
+		writePaths(stream, info.includeDirectories);
+		writePaths(stream, info.frameworkDirectories);
+		stream << info.defines << info.extraArguments;
+	}
+
+	stream << quint32(m_packages.size());
+	for(const auto& package : m_packages)
+		stream << package.name << package.path.pathOrUrl() << package.files << package.imported;
+
+	return file.commit();
+}
+
+const CatkinSessionSnapshot::Package* CatkinSessionSnapshot::package(const KDevelop::Path& path) const
+{
+	int index = m_packageIndex.value(path, -1);
+	if(index < 0)
+		return nullptr;
+
+	return &m_packages[index];
+}
+
+void CatkinSessionSnapshot::addPackage(const QString& name, const KDevelop::Path& path, const QHash<KDevelop::Path, CatkinBuildInfo>& files)
+{
+	Package package;
+	package.name = name;
+	package.path = path;
+	package.imported = true;
+
+	for(auto it = files.begin(); it != files.end(); ++it)
+		package.files.insert(path.relativePath(it.key()), addInfo(*it));
+
+	m_packageIndex.insert(path, m_packages.size());
+	m_packages << package;
+}
+
+void CatkinSessionSnapshot::addPackage(const QString& name, const KDevelop::Path& path)
+{
+	Package package;
+	package.name = name;
+	package.path = path;
+
+	m_packageIndex.insert(path, m_packages.size());
+	m_packages << package;
+}
+
+void CatkinSessionSnapshot::addPackage(const CatkinSessionSnapshot& other, const Package& package)
+{
+	Package copy = package;
+	copy.imported = false;
+	for(auto it = copy.files.begin(); it != copy.files.end(); ++it)
+		*it = addInfo(other.m_infos[*it]);
+
+	m_packageIndex.insert(copy.path, m_packages.size());
+	m_packages << copy;
+}
+
+bool CatkinSessionSnapshot::isIncomplete() const
+{
+	return std::any_of(m_packages.begin(), m_packages.end(), [](const Package& package){
+		return !package.imported;
+	});
+}
+
+bool CatkinSessionSnapshot::buildInfo(const KDevelop::Path& packagePath, const KDevelop::Path& file, CatkinBuildInfo* info) const
+{
+	const Package* pkg = package(packagePath);
+	if(!pkg)
+		return false;
+
+	int index = pkg->files.value(packagePath.relativePath(file), -1);
+	if(index < 0)
+		return false;
+
+	*info = m_infos[index];
+	return true;
+}
+
+int CatkinSessionSnapshot::addInfo(const CatkinBuildInfo& info)
+{
+	auto it = m_infoIndex.constFind(info);
+	if(it != m_infoIndex.constEnd())
+		return *it;
+
+	int index = m_infos.size();
+	m_infos << info;
+	m_infoIndex.insert(info, index);
+	return index;
+}
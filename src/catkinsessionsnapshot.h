@@ -0,0 +1,78 @@
+// Snapshot of the sub-projects and their build information between sessions
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINSESSIONSNAPSHOT_H
+#define CATKINSESSIONSNAPSHOT_H
+
+#include "catkinbuildinfocache.h"
+
+#include <util/path.h>
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/**
+ * What we knew about a workspace when it was closed: the packages and the
+ * build information of their files, as forwarded from the CMake imports.
+ *
+ * On the next open, the sub-projects are created from the snapshot right
+ * away and parse jobs get the build information from it until the packages
+ * are imported again. The snapshot is provisional, the workspace crawl and
+ * the imports replace it piece by piece.
+ *
+ * The snapshot is also the checkpoint of an interrupted import: packages
+ * that were not imported in the session that wrote it have imported unset.
+ *
+ * The file is a QDataStream, each distinct flag set is stored only once.
+ **/
+class CatkinSessionSnapshot
+{
+public:
+	struct Package
+	{
+		QString name;
+		KDevelop::Path path;
+
+		//! Path relative to the package -> index into infos()
+		QHash<QString, int> files;
+
+		//! The CMake import of the package finished in that session
+		bool imported = false;
+	};
+
+	//! @p cache is used to intern the flag sets, may be nullptr
+	bool load(const QString& fileName, CatkinBuildInfoCache* cache = nullptr);
+	bool save(const QString& fileName) const;
+
+	const QVector<Package>& packages() const
+	{ return m_packages; }
+
+	//! The package in @p path, nullptr if there is none
+	const Package* package(const KDevelop::Path& path) const;
+
+	//! Adds an imported package, @p files maps absolute paths to their build information
+	void addPackage(const QString& name, const KDevelop::Path& path, const QHash<KDevelop::Path, CatkinBuildInfo>& files);
+
+	//! Adds a package that was not imported
+	void addPackage(const QString& name, const KDevelop::Path& path);
+
+	//! Keeps the build information of @p package of the snapshot @p other, it was not imported again
+	void addPackage(const CatkinSessionSnapshot& other, const Package& package);
+
+	//! Some packages were not imported, e.g. because the import was cancelled
+	bool isIncomplete() const;
+
+	//! Build information of @p file in the package in @p packagePath
+	bool buildInfo(const KDevelop::Path& packagePath, const KDevelop::Path& file, CatkinBuildInfo* info) const;
+private:
+	int addInfo(const CatkinBuildInfo& info);
+
+	QVector<Package> m_packages;
+	QHash<KDevelop::Path, int> m_packageIndex;
+
+	QVector<CatkinBuildInfo> m_infos;
+	QHash<CatkinBuildInfo, int> m_infoIndex;
+};
+
+#endif
@@ -0,0 +1,166 @@
+// Stand-in for the CMake project manager, to measure the catkin layer alone
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinstubmanager.h"
+
+#include <interfaces/iproject.h>
+
+#include <project/projectmodel.h>
+
+#include <util/executecompositejob.h>
+
+#include <KJob>
+
+#include <QTimer>
+
+namespace
+{
+
+//! Simulates the time CMake needs to configure a project
+class LatencyJob : public KJob
+{
+public:
+	LatencyJob(int latency, QObject* parent)
+	 : KJob(parent)
+	 , m_latency(latency)
+	{}
+
+	void start() override
+	{
+		QTimer::singleShot(m_latency, this, [this](){
+			emitResult();
+		});
+	}
+private:
+	int m_latency;
+};
+
+}
+
+CatkinStubManager::CatkinStubManager(int latency, QObject* parent)
+ : KDevelop::AbstractFileManagerPlugin(QStringLiteral("kdevcatkinstub"), parent)
+ , m_latency(latency)
+{
+}
+
+CatkinStubManager::~CatkinStubManager()
+{
+}
+
+CatkinStubManager* CatkinStubManager::fromEnvironment(QObject* parent)
+{
+	if(!qEnvironmentVariableIsSet("KDEVCATKIN_STUB_CMAKE"))
+		return nullptr;
+
+	return new CatkinStubManager(qgetenv("KDEVCATKIN_STUB_CMAKE").toInt(), parent);
+}
+
+KJob* CatkinStubManager::createImportJob(KDevelop::ProjectFolderItem* item)
+{
+	auto project = item->project();
+
+	{
+		QMutexLocker lock(&m_mutex);
+		m_imported.remove(project);
+	}
+
+	auto latencyJob = new LatencyJob(m_latency, this);
+	connect(latencyJob, &KJob::result, this, [this, project](){
+		QMutexLocker lock(&m_mutex);
+		m_imported.insert(project);
+	});
+	connect(project, &QObject::destroyed, this, [this, project](){
+		QMutexLocker lock(&m_mutex);
+		m_imported.remove(project);
+	});
+
+	const QList<KJob*> jobs = {
+		KDevelop::AbstractFileManagerPlugin::createImportJob(item),
+		latencyJob
+	};
+
+	return new KDevelop::ExecuteCompositeJob(this, jobs);
+}
+
+void CatkinStubManager::projectClosing(KDevelop::IProject* project)
+{
+	QMutexLocker lock(&m_mutex);
+	m_imported.remove(project);
+}
+
+bool CatkinStubManager::isImported(KDevelop::ProjectBaseItem* item) const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_imported.contains(item->project());
+}
+
+KDevelop::IProjectBuilder* CatkinStubManager::builder() const
+{
+	return nullptr;
+}
+
+KDevelop::Path::List CatkinStubManager::includeDirectories(KDevelop::ProjectBaseItem* item) const
+{
+	return {
+		KDevelop::Path(item->project()->path(), "include"),
+		KDevelop::Path(QStringLiteral("/opt/ros/stub/include"))
+	};
+}
+
+KDevelop::Path::List CatkinStubManager::frameworkDirectories(KDevelop::ProjectBaseItem*) const
+{
+	return {};
+}
+
+QHash<QString, QString> CatkinStubManager::defines(KDevelop::ProjectBaseItem* item) const
+{
+	return {
+		{QStringLiteral("ROS_PACKAGE_NAME"), QLatin1Char('"') + item->project()->name() + QLatin1Char('"')},
+		{QStringLiteral("KDEVCATKIN_STUB"), QStringLiteral("1")}
+	};
+}
+
+QString CatkinStubManager::extraArguments(KDevelop::ProjectBaseItem*) const
+{
+	return QStringLiteral("-std=c++14");
+}
+
+KDevelop::ProjectTargetItem* CatkinStubManager::createTarget(const QString&, KDevelop::ProjectFolderItem*)
+{
+	return nullptr;
+}
+
+bool CatkinStubManager::removeTarget(KDevelop::ProjectTargetItem*)
+{
+	return false;
+}
+
+QList<KDevelop::ProjectTargetItem*> CatkinStubManager::targets(KDevelop::ProjectFolderItem*) const
+{
+	return {};
+}
+
+bool CatkinStubManager::addFilesToTarget(const QList<KDevelop::ProjectFileItem*>&, KDevelop::ProjectTargetItem*)
+{
+	return false;
+}
+
+bool CatkinStubManager::removeFilesFromTargets(const QList<KDevelop::ProjectFileItem*>&)
+{
+	return false;
+}
+
+bool CatkinStubManager::hasBuildInfo(KDevelop::ProjectBaseItem* item) const
+{
+	return isImported(item);
+}
+
+KDevelop::Path CatkinStubManager::buildDirectory(KDevelop::ProjectBaseItem* item) const
+{
+	return KDevelop::Path(item->project()->path(), "build");
+}
+
+KDevelop::Path CatkinStubManager::compiler(KDevelop::ProjectTargetItem*) const
+{
+	return {};
+}
@@ -0,0 +1,82 @@
+// Stand-in for the CMake project manager, to measure the catkin layer alone
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINSTUBMANAGER_H
+#define CATKINSTUBMANAGER_H
+
+#include <project/abstractfilemanagerplugin.h>
+#include <project/interfaces/iprojectfilemanager.h>
+#include <project/interfaces/ibuildsystemmanager.h>
+
+#include <QMutex>
+#include <QSet>
+
+/**
+ * Imports sub-projects like KDevCMakeManager would, without running CMake.
+ *
+ * The file tree is listed as usual, the import then finishes after a fixed
+ * latency and every file gets the same canned build information. This
+ * allows to profile and load-test routing, caching and scheduling in
+ * CatkinManager with thousands of packages.
+ *
+ * Set with CatkinManager::setCMakeManager(), or by setting
+ * KDEVCATKIN_STUB_CMAKE to the import latency in ms.
+ **/
+class CatkinStubManager
+  : public KDevelop::AbstractFileManagerPlugin
+  , public virtual KDevelop::IProjectFileManager
+  , public virtual KDevelop::IBuildSystemManager
+{
+Q_OBJECT
+
+Q_INTERFACES(KDevelop::IProjectFileManager)
+Q_INTERFACES(KDevelop::IBuildSystemManager)
+
+public:
+	explicit CatkinStubManager(int latency, QObject* parent = nullptr);
+	~CatkinStubManager() override;
+
+	//! Returns a stub if KDEVCATKIN_STUB_CMAKE is set, nullptr otherwise
+	static CatkinStubManager* fromEnvironment(QObject* parent);
+
+	virtual Features features() const override { return Features(Folders | Files); }
+
+	virtual KJob* createImportJob(KDevelop::ProjectFolderItem* item) override;
+
+	virtual KDevelop::IProjectBuilder* builder() const override;
+
+	virtual KDevelop::Path::List includeDirectories(KDevelop::ProjectBaseItem *item) const override;
+	virtual KDevelop::Path::List frameworkDirectories(KDevelop::ProjectBaseItem *item) const override;
+	virtual QHash<QString, QString> defines(KDevelop::ProjectBaseItem *item) const override;
+	virtual QString extraArguments(KDevelop::ProjectBaseItem* item) const override;
+
+	virtual KDevelop::ProjectTargetItem* createTarget(const QString& target, KDevelop::ProjectFolderItem *parent) override;
+	virtual bool removeTarget(KDevelop::ProjectTargetItem* target) override;
+	virtual QList<KDevelop::ProjectTargetItem*> targets(KDevelop::ProjectFolderItem*) const override;
+
+	virtual bool addFilesToTarget(
+		const QList<KDevelop::ProjectFileItem*>& files,
+		KDevelop::ProjectTargetItem* target
+	) override;
+
+	virtual bool removeFilesFromTargets(
+		const QList<KDevelop::ProjectFileItem*> &files
+	) override;
+
+	virtual bool hasBuildInfo(KDevelop::ProjectBaseItem* item) const override;
+
+	virtual KDevelop::Path buildDirectory(KDevelop::ProjectBaseItem* item) const override;
+	virtual KDevelop::Path compiler(KDevelop::ProjectTargetItem* p) const override;
+public Q_SLOTS:
+	//! Forgets @p project, called by CatkinSubProject::unload() like for KDevCMakeManager
+	void projectClosing(KDevelop::IProject* project);
+private:
+	bool isImported(KDevelop::ProjectBaseItem* item) const;
+
+	int m_latency;
+
+	mutable QMutex m_mutex;
+	QSet<KDevelop::IProject*> m_imported;
+};
+
+#endif
@@ -2,6 +2,7 @@
 // Author: Max Schwarz <max.schwarz@online.de>
 
 #include "catkinsubproject.h"
+#include "catkinconfigstore.h"
 
 #include <interfaces/iplugin.h>
 
@@ -13,7 +14,11 @@
 
 #include <serialization/indexedstring.h>
 
+#include <QDateTime>
 #include <QDebug>
+#include <QDir>
+#include <QMetaObject>
+#include <QTimer>
 
 #include <KIO/StatJob>
 #include <KIO/MkdirJob>
@@ -21,92 +26,216 @@
 
 #include <KConfig>
 #include <KConfigGroup>
+#include <KJob>
 #include <KMessageBox>
 
 #include <KLocalizedString>
 
-CatkinSubProject::CatkinSubProject(QObject* parent)
+CatkinSubProject::CatkinSubProject(
+	KDevelop::IProject* workspace, const QString& name,
+	const KDevelop::Path& path, const KDevelop::Path& buildPath,
+	KDevelop::IPlugin* manager, QObject* parent)
  : KDevelop::IProject(parent)
+ , m_workspace(workspace)
+ , m_projectFilePath(path)
+ , m_buildPath(buildPath)
+ , m_projectPath(path.parent())
+ , m_manager(manager)
+ , m_name(name)
 {
-
+	touch();
 }
 
 CatkinSubProject::~CatkinSubProject()
 {
 }
 
-bool CatkinSubProject::open(
-	const KDevelop::Path& path, const KDevelop::Path& buildPath,
-	KDevelop::IPlugin* manager)
+/**
+ * Opens the project and developer configuration of a sub-project.
+ *
+ * Local files are used directly. Only for remote files the configuration is
+ * copied to temporary files, using asynchronous KIO jobs.
+ **/
+class CatkinSubProject::OpenJob : public KJob
 {
-	m_projectFilePath = path;
-	m_buildPath = buildPath;
+public:
+	explicit OpenJob(CatkinSubProject* project)
+	 : KJob(project)
+	 , m_project(project)
+	{
+	}
+
+	void start() override
+	{
+		QTimer::singleShot(0, this, &OpenJob::run);
+	}
+protected:
+	bool doKill() override
+	{
+		// Running KIO jobs only fill the temporary files, let them be
+		m_killed = true;
+		return true;
+	}
+private:
+	void run()
+	{
+		if(m_killed)
+			return;
 
-	m_projectPath = path.parent();
+		auto& developerFilePath = m_project->m_developerFilePath;
+		const auto& projectFilePath = m_project->m_projectFilePath;
 
-	// developerfile == dirname(projectFileUrl) ."/.kdev4/". basename(projectfileUrl)
-	m_developerFilePath = m_projectFilePath;
-	m_developerFilePath.setLastPathSegment(QStringLiteral(".kdev4"));
-	m_developerFilePath.addPath(m_projectFilePath.lastPathSegment());
+		// developerfile == dirname(projectFileUrl) ."/.kdev4/". basename(projectfileUrl)
+		developerFilePath = projectFilePath;
+		developerFilePath.setLastPathSegment(QStringLiteral(".kdev4"));
+		developerFilePath.addPath(projectFilePath.lastPathSegment());
 
-	KIO::StatJob* statJob = KIO::stat(m_developerFilePath.toUrl(), KIO::HideProgressInfo);
-	if(!statJob->exec())
-	{
-		// the developerfile does not exist yet, check if its folder exists
-		// the developerfile itself will get created below
-		QUrl dir = m_developerFilePath.parent().toUrl();
-		statJob = KIO::stat(dir, KIO::HideProgressInfo);
-		if(!statJob->exec())
+		// Consolidated mode: everything lives in the workspace store
+		if(m_project->m_configStore)
 		{
-			KIO::SimpleJob* mkdirJob = KIO::mkdir(dir);
-			if(!mkdirJob->exec())
-			{
-				KMessageBox::sorry(
-					nullptr,
-					i18n("Unable to create hidden dir (%1) for developer file",
-					dir.toDisplayString(QUrl::PreferLocalFile) )
-				);
-				return false;
-			}
+			finish();
+			return;
+		}
+
+		if(!projectFilePath.isLocalFile() || !developerFilePath.isLocalFile())
+		{
+			statDeveloperFile();
+			return;
+		}
+
+		// Fast path: no KIO, no temporary copies
+		QString developerDir = developerFilePath.parent().toLocalFile();
+		if(!QDir().mkpath(developerDir))
+		{
+			fail(i18n("Unable to create hidden dir (%1) for developer file", developerDir));
+			return;
 		}
+
+		m_project->m_projectTempFilePath = projectFilePath.toLocalFile();
+		m_project->m_developerTempFilePath = developerFilePath.toLocalFile();
+
+		finish();
 	}
 
-	m_projectTempFile.open();
-	auto copyJob = KIO::file_copy(
-		m_projectFilePath.toUrl(),
-		QUrl::fromLocalFile(m_projectTempFile.fileName()),
-		-1, KIO::HideProgressInfo | KIO::Overwrite
-	);
-// 	KJobWidgets::setWindow(copyJob, Core::self()->uiController()->activeMainWindow());
-	if(!copyJob->exec())
+	void statDeveloperFile()
 	{
-		KMessageBox::sorry( nullptr,
-						i18n("Unable to get project file: %1",
-						m_projectFilePath.pathOrUrl() ) );
-		return false;
+		auto job = KIO::stat(m_project->m_developerFilePath.toUrl(), KIO::HideProgressInfo);
+		connect(job, &KJob::result, this, [this](KJob* job){
+			// the developerfile does not exist yet, check if its folder exists
+			// the developerfile itself will get created later
+			if(job->error())
+				statDeveloperDir();
+			else
+				copyProjectFile();
+		});
 	}
 
-	if(m_developerFilePath.isLocalFile())
+	void statDeveloperDir()
 	{
-		m_developerTempFilePath = m_developerFilePath.toLocalFile();
+		QUrl dir = m_project->m_developerFilePath.parent().toUrl();
+
+		auto job = KIO::stat(dir, KIO::HideProgressInfo);
+		connect(job, &KJob::result, this, [this, dir](KJob* job){
+			if(!job->error())
+			{
+				copyProjectFile();
+				return;
+			}
+
+			auto mkdirJob = KIO::mkdir(dir);
+			connect(mkdirJob, &KJob::result, this, [this, dir](KJob* job){
+				if(job->error())
+				{
+					fail(i18n("Unable to create hidden dir (%1) for developer file",
+						dir.toDisplayString(QUrl::PreferLocalFile)));
+					return;
+				}
+
+				copyProjectFile();
+			});
+		});
 	}
-	else
+
+	void copyProjectFile()
 	{
-		QTemporaryFile tmp;
-		tmp.open();
-		m_developerTempFilePath = tmp.fileName();
+		m_project->m_projectTempFile.open();
+		m_project->m_projectTempFilePath = m_project->m_projectTempFile.fileName();
 
 		auto job = KIO::file_copy(
-			m_developerFilePath.toUrl(),
-			QUrl::fromLocalFile(m_developerTempFilePath),
+			m_project->m_projectFilePath.toUrl(),
+			QUrl::fromLocalFile(m_project->m_projectTempFilePath),
+			-1, KIO::HideProgressInfo | KIO::Overwrite
+		);
+		connect(job, &KJob::result, this, [this](KJob* job){
+			if(job->error())
+			{
+				fail(i18n("Unable to get project file: %1",
+					m_project->m_projectFilePath.pathOrUrl()));
+				return;
+			}
+
+			copyDeveloperFile();
+		});
+	}
+
+	void copyDeveloperFile()
+	{
+		m_project->m_developerTempFile.open();
+		m_project->m_developerTempFilePath = m_project->m_developerTempFile.fileName();
+
+		auto job = KIO::file_copy(
+			m_project->m_developerFilePath.toUrl(),
+			QUrl::fromLocalFile(m_project->m_developerTempFilePath),
 			-1, KIO::HideProgressInfo | KIO::Overwrite
 		);
-// 		KJobWidgets::setWindow(job, Core::self()->uiController()->activeMainWindow());
-		job->exec();
+
+		// The developer file does not need to exist yet
+		connect(job, &KJob::result, this, &OpenJob::finish);
+	}
+
+	void finish()
+	{
+		if(m_killed)
+			return;
+
+		if(!m_project->setupConfiguration())
+		{
+			fail(i18n("Could not open project %1", m_project->m_projectFilePath.pathOrUrl()));
+			return;
+		}
+
+		emitResult();
+	}
+
+	void fail(const QString& message)
+	{
+		if(m_killed)
+			return;
+
+		setError(KJob::UserDefinedError);
+		setErrorText(message);
+		emitResult();
+	}
+
+	CatkinSubProject* m_project;
+	bool m_killed = false;
+};
+
+KJob* CatkinSubProject::open()
+{
+	return new OpenJob(this);
+}
+
+bool CatkinSubProject::setupConfiguration()
+{
+	if(m_configStore)
+		m_cfg = m_configStore->configuration(m_name);
+	else
+	{
+		m_cfg = KSharedConfig::openConfig(m_developerTempFilePath);
+		m_cfg->addConfigSources(QStringList() << m_projectTempFilePath);
 	}
 
-	m_cfg = KSharedConfig::openConfig(m_developerTempFilePath);
-	m_cfg->addConfigSources(QStringList() << m_projectTempFile.fileName());
 	KConfigGroup projectGroup( m_cfg, "Project" );
 
 	// Initialize CMake to the build directory
@@ -118,27 +247,74 @@ bool CatkinSubProject::open(
 
 		KConfigGroup dirGroup(&cmakeGroup, "CMake Build Directory 0");
 
-		dirGroup.writeEntry("Build Directory Path", buildPath.toLocalFile());
+		dirGroup.writeEntry("Build Directory Path", m_buildPath.toLocalFile());
 		dirGroup.writeEntry("Build Type", "");
 		dirGroup.writeEntry("Install Directory", ""); // Has to be empty, otherwise KDev gives /usr/local to cmake
 
-		m_cfg->sync();
+		// The store is synced once for all packages
+		if(m_configStore)
+			m_configStore->store(m_name, m_cfg);
+		else
+			m_cfg->sync();
 	}
 
 	m_name = projectGroup.readEntry("Name", m_projectFilePath.lastPathSegment());
 
-	m_manager = manager;
 	KDevelop::IProjectFileManager* fileManager = m_manager->extension<KDevelop::IProjectFileManager>();
 	Q_ASSERT(fileManager);
 
-	m_topItem = fileManager->import(this);
+	auto topItem = fileManager->import(this);
+	{
+		QWriteLocker lock(&m_treeLock);
+		m_topItem = topItem;
+	}
+	return topItem != nullptr;
+}
+
+void CatkinSubProject::unload()
+{
 	if(!m_topItem)
+		return;
+
+	close();
+
+	// The CMake manager keeps per-project data until the project is closed.
+	// We are not known to the project controller, so tell the manager
+	// directly instead of announcing the close to every plugin.
+	if(m_manager->metaObject()->indexOfMethod("projectClosing(KDevelop::IProject*)") >= 0)
+	{
+		QMetaObject::invokeMethod(m_manager, "projectClosing", Qt::DirectConnection,
+			Q_ARG(KDevelop::IProject*, this));
+	}
+
+	// Wait for parse jobs still using the tree
+	{
+		QWriteLocker lock(&m_treeLock);
+		delete m_topItem;
+		m_topItem = nullptr;
+	}
+
 	{
-		KMessageBox::sorry(nullptr, i18n("Could not open project"));
-		return false;
+		QMutexLocker lock(&m_itemsMutex);
+		m_items.clear();
 	}
 
-	return true;
+	m_fileSet.clear();
+	m_cfg.reset();
+	m_projectTempFile.close();
+	m_developerTempFile.close();
+
+	setState(Discovered);
+}
+
+void CatkinSubProject::touch()
+{
+	m_lastUsed.store(QDateTime::currentMSecsSinceEpoch());
+}
+
+qint64 CatkinSubProject::lastUsed() const
+{
+	return m_lastUsed.load();
 }
 
 KDevelop::Path CatkinSubProject::projectFile() const
@@ -161,6 +337,11 @@ KDevelop::Path CatkinSubProject::path() const
 	return m_projectPath;
 }
 
+void CatkinSubProject::setConfigStore(CatkinConfigStore* store)
+{
+	m_configStore = store;
+}
+
 KSharedConfigPtr CatkinSubProject::projectConfiguration() const
 {
 	return m_cfg;
@@ -168,7 +349,7 @@ KSharedConfigPtr CatkinSubProject::projectConfiguration() const
 
 void CatkinSubProject::reloadModel()
 {
-	// TODO
+	emit reloadRequested(this);
 }
 
 void CatkinSubProject::addToFileSet(KDevelop::ProjectFileItem* file)
@@ -197,7 +378,15 @@ QSet<KDevelop::IndexedString> CatkinSubProject::fileSet() const
 
 bool CatkinSubProject::isReady() const
 {
-    return true; // TODO
+	return state() == Ready;
+}
+
+void CatkinSubProject::setState(State state)
+{
+	if(m_state.fetchAndStoreOrdered(state) == state)
+		return;
+
+	emit stateChanged(this, state);
 }
 
 KDevelop::ProjectFolderItem* CatkinSubProject::projectItem() const
@@ -217,6 +406,13 @@ KDevelop::IBuildSystemManager * CatkinSubProject::buildSystemManager() const
 
 void CatkinSubProject::close()
 {
+	if(m_configStore)
+	{
+		if(m_cfg)
+			m_configStore->store(m_name, m_cfg);
+		return;
+	}
+
 	if(!m_developerFilePath.isLocalFile())
     {
 		auto copyJob = KIO::file_copy(
@@ -241,7 +437,7 @@ void CatkinSubProject::setReloadJob(KJob*)
 
 QString CatkinSubProject::projectTempFile() const
 {
-	return m_projectTempFile.fileName();
+	return m_projectTempFilePath;
 }
 
 bool CatkinSubProject::inProject(const KDevelop::IndexedString& url) const
@@ -249,7 +445,8 @@ bool CatkinSubProject::inProject(const KDevelop::IndexedString& url) const
 	if(m_fileSet.contains(url))
 		return true;
 
-	return !itemsForPath(url).isEmpty();
+	QMutexLocker lock(&m_itemsMutex);
+	return m_items.contains(url);
 }
 
 QList<KDevelop::ProjectFileItem *> CatkinSubProject::filesForPath(const KDevelop::IndexedString& file) const
@@ -280,28 +477,38 @@ QList<KDevelop::ProjectBaseItem *> CatkinSubProject::itemsForPath(const KDevelop
 	if(path.isEmpty())
 		return {};
 
-	if(!m_topItem->model())
+	QMutexLocker lock(&m_itemsMutex);
+	return m_items.value(path);
+}
+
+void CatkinSubProject::addItems(KDevelop::ProjectBaseItem* item)
+{
 	{
-		// this gets hit when the project has not yet been added to the model
-		// i.e. during import phase
-		// TODO: should we handle this somehow?
-		// possible idea: make the item<->path hash per-project
-		return {};
+		QMutexLocker lock(&m_itemsMutex);
+
+		auto& items = m_items[item->indexedPath()];
+		if(!items.contains(item))
+			items << item;
 	}
 
-	Q_ASSERT(m_topItem->model());
-	QList<KDevelop::ProjectBaseItem*> items = m_topItem->model()->itemsForPath(path);
+	for(auto child : item->children())
+		addItems(child);
+}
 
-	auto it = items.begin();
-	while(it != items.end())
-	{
-		if((*it)->project() != static_cast<const KDevelop::IProject*>(this))
-			it = items.erase(it);
-		else
-			++it;
-	}
+void CatkinSubProject::removeItems(KDevelop::ProjectBaseItem* item)
+{
+	for(auto child : item->children())
+		removeItems(child);
 
-	return items;
+	QMutexLocker lock(&m_itemsMutex);
+
+	auto it = m_items.find(item->indexedPath());
+	if(it == m_items.end())
+		return;
+
+	it->removeOne(item);
+	if(it->isEmpty())
+		m_items.erase(it);
 }
 
 
@@ -10,21 +10,83 @@
 
 #include <KSharedConfig>
 
+#include <QAtomicInteger>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
 #include <QSet>
 #include <QTemporaryFile>
 
+class CatkinConfigStore;
+
 class CatkinSubProject
  : public KDevelop::IProject
 {
 Q_OBJECT
 public:
-	explicit CatkinSubProject(QObject *parent = nullptr);
-	~CatkinSubProject() override;
-
-	bool open(
+	//! Import progress of the package
+	enum State
+	{
+		Discovered, //!< Known from the workspace crawl, not loaded
+		Opening,    //!< Reading the project configuration
+		Importing,  //!< CMake import running
+		Ready,      //!< Imported, build information is available
+		Failed      //!< Opening or importing failed
+	};
+	Q_ENUM(State)
+
+	CatkinSubProject(
+		KDevelop::IProject* workspace, const QString& name,
 		const KDevelop::Path& path, const KDevelop::Path& buildPath,
-		KDevelop::IPlugin* manager
+		KDevelop::IPlugin* manager, QObject *parent = nullptr
 	);
+	~CatkinSubProject() override;
+
+	//! Keep the configuration in @p store instead of .kdev4 files, call before open()
+	void setConfigStore(CatkinConfigStore* store);
+
+	//! Returns a job opening the project, not started yet
+	KJob* open();
+
+	//! Drops the project tree and configuration, open() can be called again
+	void unload();
+
+	//! Outside the main thread, only call with treeLock() held for reading
+	bool isOpen() const
+	{ return m_topItem; }
+
+	/**
+	 * Parse jobs hold this for reading while they use items of the project
+	 * tree, unload() takes it for writing before deleting the tree.
+	 **/
+	QReadWriteLock* treeLock() const
+	{ return &m_treeLock; }
+
+	//! Thread-safe, can be called from parse jobs
+	State state() const
+	{ return static_cast<State>(m_state.load()); }
+
+	//! Called by the loading job, emits stateChanged()
+	void setState(State state);
+
+	//! The catkin workspace this package belongs to
+	KDevelop::IProject* workspace() const
+	{ return m_workspace; }
+
+	//! Build directory of the package in the catkin build space
+	KDevelop::Path buildPath() const
+	{ return m_buildPath; }
+
+	//! Marks the sub-project as used, see lastUsed()
+	void touch();
+
+	//! msecs since epoch of the last touch()
+	qint64 lastUsed() const;
+
+	//! Adds @p item and its children to the path lookup table
+	void addItems(KDevelop::ProjectBaseItem* item);
+	//! Removes @p item and its children from the path lookup table
+	void removeItems(KDevelop::ProjectBaseItem* item);
 
 	QList<KDevelop::ProjectBaseItem*> itemsForPath(const KDevelop::IndexedString& path) const override;
 	QList<KDevelop::ProjectFileItem*> filesForPath(const KDevelop::IndexedString& file) const override;
@@ -62,7 +124,19 @@ public Q_SLOTS:
 	bool inProject(const KDevelop::IndexedString &url) const override;
 
 	void setReloadJob(KJob* job) override;
+Q_SIGNALS:
+	void stateChanged(CatkinSubProject* project, CatkinSubProject::State state);
+
+	//! reloadModel() was called, the manager takes care of it
+	void reloadRequested(CatkinSubProject* project);
 private:
+	class OpenJob;
+	friend class OpenJob;
+
+	bool setupConfiguration();
+
+	KDevelop::IProject* m_workspace;
+
 	KDevelop::Path m_projectFilePath;
 	KDevelop::Path m_buildPath;
 	KDevelop::Path m_developerFilePath;
@@ -71,15 +145,26 @@ private:
 	KDevelop::IPlugin* m_manager;
 
 	QTemporaryFile m_projectTempFile;
+	QTemporaryFile m_developerTempFile;
+	QString m_projectTempFilePath;
 	QString m_developerTempFilePath;
 
 	KSharedConfigPtr m_cfg;
+	CatkinConfigStore* m_configStore = nullptr;
 
 	QSet<KDevelop::IndexedString> m_fileSet;
 
-	KDevelop::ProjectFolderItem* m_topItem;
+	//! Our own item<->path lookup table, also works while importing
+	mutable QMutex m_itemsMutex;
+	QHash<KDevelop::IndexedString, QList<KDevelop::ProjectBaseItem*>> m_items;
+
+	mutable QReadWriteLock m_treeLock;
+	KDevelop::ProjectFolderItem* m_topItem = nullptr;
 
 	QString m_name;
+
+	QAtomicInteger<qint64> m_lastUsed;
+	QAtomicInt m_state{Discovered};
 };
 
 #endif
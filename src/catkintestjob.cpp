@@ -0,0 +1,431 @@
+// Runs the tests of catkin packages, sharded over all cores
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkintestjob.h"
+#include "catkinbuildoutputmodel.h"
+#include "catkinmanager.h"
+#include "catkinsubproject.h"
+
+#include <outputview/outputdelegate.h>
+
+#include <interfaces/iproject.h>
+
+#include <project/projectmodel.h>
+
+#include <KLocalizedString>
+
+#include <ThreadWeaver/ThreadWeaver>
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QProcess>
+#include <QStandardPaths>
+#include <QThread>
+
+#include <algorithm>
+
+CatkinTestJob::CatkinTestJob(CatkinManager* manager, KDevelop::IProject* workspace, QObject* parent)
+ : KDevelop::OutputJob(parent)
+ , m_manager(manager)
+ , m_workspace(workspace)
+ , m_maxConcurrency(QThread::idealThreadCount())
+ , m_worker(new ThreadWeaver::Queue(this))
+{
+	m_worker->setMaximumNumberOfThreads(1);
+	connect(this, &CatkinTestJob::prepared, this, &CatkinTestJob::startTests);
+
+	setCapabilities(Killable);
+	setStandardToolView(KDevelop::IOutputView::TestView);
+	setBehaviours(KDevelop::IOutputView::AllowUserClose | KDevelop::IOutputView::AutoScroll);
+	setTitle(i18n("Test %1", workspace->name()));
+}
+
+CatkinTestJob::~CatkinTestJob()
+{
+	// Make sure the worker does not touch us after destruction
+	m_worker->dequeue();
+	m_worker->finish();
+}
+
+void CatkinTestJob::setPackages(const QList<CatkinSubProject*>& packages)
+{
+	m_selection = packages;
+}
+
+void CatkinTestJob::setAffectedOnly(bool affectedOnly)
+{
+	m_affectedOnly = affectedOnly;
+}
+
+void CatkinTestJob::setMaximumConcurrency(int shards)
+{
+	m_maxConcurrency = qMax(1, shards);
+}
+
+void CatkinTestJob::start()
+{
+	m_model = new CatkinBuildOutputModel(m_workspace);
+	setModel(m_model);
+	setDelegate(new KDevelop::OutputDelegate);
+	startOutput();
+
+	m_cmake = QStandardPaths::findExecutable(QStringLiteral("cmake"));
+	if(m_cmake.isEmpty())
+	{
+		setError(UserDefinedError);
+		setErrorText(i18n("Could not find cmake"));
+		emitResult();
+		return;
+	}
+
+	m_environment = CatkinManager::buildEnvironment(m_workspace);
+
+	// The sub-projects are only touched here, the worker gets copies
+	const auto packages = CatkinDependencyGraph::packages(m_manager->subprojects(m_workspace));
+
+	QStringList names;
+	for(auto project : m_selection)
+		names << project->name();
+
+	m_worker->enqueue(ThreadWeaver::make_job([this, packages, names](){
+		prepare(packages, names);
+		emit prepared(QPrivateSignal());
+	}));
+}
+
+void CatkinTestJob::prepare(const QVector<CatkinDependencyGraph::Package>& packages, const QStringList& names)
+{
+	m_graph.reset(new CatkinDependencyGraph(packages));
+
+	for(const QString& name : names.isEmpty() ? m_graph->packageNames() : names)
+	{
+		if(m_graph->package(name))
+			m_testSelection.insert(name);
+	}
+
+	if(m_affectedOnly)
+	{
+		m_affected.reset(new CatkinRebuildSet(*m_graph, m_testSelection, CatkinRebuildSet::Tested));
+
+		m_testSelection.clear();
+		for(const auto& entry : m_affected->entries())
+			m_testSelection.insert(entry.package);
+	}
+}
+
+void CatkinTestJob::startTests()
+{
+	if(m_killed)
+		return;
+
+	if(m_affected)
+	{
+		for(const auto& entry : m_affected->entries())
+			m_model->appendLine(entry.package, i18n("Affected: %1", m_affected->reasonText(entry)));
+	}
+
+	for(const QString& name : m_testSelection)
+	{
+		Package package;
+		package.project = m_graph->package(name);
+
+		if(!QFile::exists(KDevelop::Path(package.project->buildPath(), "CMakeCache.txt").toLocalFile()))
+		{
+			m_model->appendLine(name, i18n("Not configured, skipping tests"));
+			continue;
+		}
+
+		// Results go to ${CATKIN_TEST_RESULTS_DIR}/<package>
+		QString resultDirectory = m_manager->cmakeCacheValue(package.project, "CATKIN_TEST_RESULTS_DIR");
+		if(resultDirectory.isEmpty())
+			package.resultDirectory = KDevelop::Path(package.project->buildPath(), QStringLiteral("test_results/") + name);
+		else
+			package.resultDirectory = KDevelop::Path(KDevelop::Path(resultDirectory), name);
+
+		package.remainingShards = 1;
+		m_packages.insert(name, package);
+		m_model->startPackage(name, package.project->buildPath(), package.project->path());
+
+		Shard prepare;
+		prepare.package = name;
+		prepare.target = QStringLiteral("tests");
+		prepare.prepare = true;
+		m_queue.enqueue(prepare);
+	}
+
+	setTotalAmount(KJob::Items, m_packages.size());
+
+	if(m_packages.isEmpty())
+	{
+		report();
+		emitResult();
+		return;
+	}
+
+	startShards();
+}
+
+bool CatkinTestJob::doKill()
+{
+	// A prepared() that is already queued must not start anything
+	m_killed = true;
+	m_worker->dequeue();
+
+	for(auto it = m_running.begin(); it != m_running.end(); ++it)
+	{
+		it.key()->disconnect(this);
+		it.key()->kill();
+		it.key()->waitForFinished(1000);
+	}
+
+	m_running.clear();
+	m_queue.clear();
+	m_usedSlots = 0;
+
+	return true;
+}
+
+QStringList CatkinTestJob::testTargets(CatkinSubProject* project) const
+{
+	const QString prefix = QStringLiteral("run_tests_%1_").arg(project->name());
+
+	// Per-type aggregates like run_tests_<package>_gtest
+	static const QStringList AGGREGATES{
+		QStringLiteral("gtest"), QStringLiteral("rostest"),
+		QStringLiteral("nosetests"), QStringLiteral("pytest")
+	};
+
+	QStringList targets;
+
+	if(project->isOpen())
+	{
+		QList<KDevelop::ProjectFolderItem*> stack{project->projectItem()};
+		while(!stack.isEmpty())
+		{
+			KDevelop::ProjectFolderItem* folder = stack.takeLast();
+
+			for(auto target : folder->targetList())
+			{
+				QString name = target->text();
+				if(name.startsWith(prefix) && !AGGREGATES.contains(name.mid(prefix.size())))
+					targets << name;
+			}
+
+			stack << folder->folderList();
+		}
+
+		targets.removeDuplicates();
+	}
+
+	// Not imported (yet), or no separate targets
+	if(targets.isEmpty())
+		targets << QStringLiteral("run_tests_") + project->name();
+
+	return targets;
+}
+
+void CatkinTestJob::startShards()
+{
+	for(auto it = m_queue.begin(); it != m_queue.end() && m_usedSlots < m_maxConcurrency;)
+	{
+		// Other shards are running in the build directory of the package
+		const Package& package = m_packages[it->package];
+		if(package.runningShards > 0 && !package.parallelShards)
+		{
+			++it;
+			continue;
+		}
+
+		Shard shard = *it;
+		it = m_queue.erase(it);
+
+		if(shard.prepare)
+		{
+			// Share the free slots between the packages still to be prepared
+			int prepares = 1 + std::count_if(m_queue.constBegin(), m_queue.constEnd(), [](const Shard& queued){
+				return queued.prepare;
+			});
+			shard.slots = qMax(1, (m_maxConcurrency - m_usedSlots) / prepares);
+		}
+
+		startShard(shard);
+	}
+}
+
+void CatkinTestJob::startShard(Shard shard)
+{
+	Package& package = m_packages[shard.package];
+	const QString buildPath = package.project->buildPath().toLocalFile();
+
+	// The /fast rule runs only the target itself, without checking the
+	// build system or the dependencies (built by the prepare shard)
+	QString target = shard.target;
+	if(!shard.prepare && package.parallelShards)
+		target += QStringLiteral("/fast");
+
+	QStringList arguments{
+		QStringLiteral("--build"), buildPath,
+		QStringLiteral("--target"), target
+	};
+
+	if(shard.prepare)
+	{
+		QDir(package.resultDirectory.toLocalFile()).removeRecursively();
+		arguments << QStringLiteral("--") << QStringLiteral("-j%1").arg(shard.slots);
+	}
+
+	m_model->appendLine(shard.package, QStringLiteral("cmake ") + arguments.join(QLatin1Char(' ')));
+
+	QProcess* process = new QProcess(this);
+	process->setProcessChannelMode(QProcess::MergedChannels);
+	process->setProcessEnvironment(m_environment);
+	process->setWorkingDirectory(buildPath);
+
+	connect(process, &QProcess::readyRead, this, [this, process](){
+		m_model->appendOutput(m_running.value(process).package, process->readAll());
+	});
+	connect(process, static_cast<void(QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), this, [this, process](){
+		shardFinished(process);
+	});
+	connect(process, &QProcess::errorOccurred, this, [this, process](QProcess::ProcessError error){
+		if(error == QProcess::FailedToStart)
+			shardFinished(process);
+	}, Qt::QueuedConnection);
+
+	m_running.insert(process, shard);
+	m_usedSlots += shard.slots;
+	package.runningShards++;
+
+	process->start(m_cmake, arguments);
+}
+
+void CatkinTestJob::shardFinished(QProcess* process)
+{
+	auto it = m_running.find(process);
+	if(it == m_running.end())
+		return;
+
+	Shard shard = *it;
+	m_running.erase(it);
+	m_usedSlots -= shard.slots;
+
+	m_model->appendOutput(shard.package, process->readAll());
+	m_model->endOutput(shard.package);
+
+	bool success = process->error() != QProcess::FailedToStart
+		&& process->exitStatus() == QProcess::NormalExit
+		&& process->exitCode() == 0;
+
+	process->deleteLater();
+
+	Package& package = m_packages[shard.package];
+	package.remainingShards--;
+	package.runningShards--;
+
+	if(!success)
+		package.failed = true;
+	else if(shard.prepare)
+	{
+		const QStringList targets = testTargets(package.project);
+
+		// Separate test targets carry the test command themselves
+		package.parallelShards = !targets.contains(QStringLiteral("run_tests_") + shard.package)
+			&& m_manager->usesMakefiles(package.project);
+
+		for(const QString& target : targets)
+		{
+			Shard testShard;
+			testShard.package = shard.package;
+			testShard.target = target;
+			m_queue.enqueue(testShard);
+
+			package.remainingShards++;
+		}
+	}
+
+	if(package.remainingShards == 0)
+		packageFinished(shard.package);
+
+	startShards();
+
+	if(m_running.isEmpty() && m_queue.isEmpty())
+	{
+		report();
+		emitResult();
+	}
+}
+
+void CatkinTestJob::packageFinished(const QString& name)
+{
+	Package& package = m_packages[name];
+
+	QVector<CatkinTestResult> results;
+	QDirIterator it(package.resultDirectory.toLocalFile(), {QStringLiteral("*.xml")},
+		QDir::Files, QDirIterator::Subdirectories);
+	while(it.hasNext())
+		CatkinTestResult::read(it.next(), name, &results);
+
+	for(const CatkinTestResult& result : results)
+	{
+		QString test = result.suite.isEmpty() ? result.name : result.suite + QLatin1Char('.') + result.name;
+
+		switch(result.status)
+		{
+			case CatkinTestResult::Passed:
+				m_model->appendLine(name, i18n("PASSED %1 (%2 s)", test, result.time));
+				break;
+			case CatkinTestResult::Skipped:
+				m_model->appendLine(name, i18n("SKIPPED %1", test));
+				break;
+			case CatkinTestResult::Failed:
+				m_model->appendLine(name, i18n("FAILED %1 (%2 s): %3", test, result.time, result.message));
+				package.failed = true;
+				break;
+		}
+	}
+
+	m_results << results;
+
+	if(package.failed)
+		m_failed << name;
+	else if(m_affected)
+		m_affected->markDone(name);
+
+	m_model->finishPackage(name);
+
+	setProcessedAmount(KJob::Items, processedAmount(KJob::Items) + 1);
+	emitPercent(processedAmount(KJob::Items), totalAmount(KJob::Items));
+}
+
+void CatkinTestJob::report()
+{
+	QVector<CatkinTestResult> slowest = m_results;
+	std::sort(slowest.begin(), slowest.end(), [](const CatkinTestResult& a, const CatkinTestResult& b){
+		return a.time > b.time;
+	});
+
+	const QString tag = m_workspace->name();
+
+	if(!slowest.isEmpty())
+	{
+		m_model->appendLine(tag, i18n("Slowest tests:"));
+		for(int i = 0; i < slowest.size() && i < 10; ++i)
+		{
+			m_model->appendLine(tag, QStringLiteral("  %1 s  %2/%3.%4").arg(slowest[i].time, 0, 'f', 3)
+				.arg(slowest[i].package, slowest[i].suite, slowest[i].name));
+		}
+	}
+
+	int failedTests = std::count_if(m_results.constBegin(), m_results.constEnd(), [](const CatkinTestResult& result){
+		return result.status == CatkinTestResult::Failed;
+	});
+
+	m_model->appendLine(tag, i18n("%1 tests, %2 failed", m_results.size(), failedTests));
+
+	if(!m_failed.isEmpty())
+	{
+		setError(UserDefinedError);
+		setErrorText(i18n("Tests failed in packages: %1", m_failed.join(QStringLiteral(", "))));
+	}
+}
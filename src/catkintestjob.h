@@ -0,0 +1,146 @@
+// Runs the tests of catkin packages, sharded over all cores
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINTESTJOB_H
+#define CATKINTESTJOB_H
+
+#include <outputview/outputjob.h>
+
+#include "catkindependencygraph.h"
+#include "catkinrebuildset.h"
+#include "catkintestresult.h"
+
+#include <QHash>
+#include <QList>
+#include <QProcessEnvironment>
+#include <QQueue>
+#include <QSet>
+#include <QStringList>
+
+#include <memory>
+
+class QProcess;
+
+namespace ThreadWeaver
+{
+	class Queue;
+}
+
+class CatkinBuildOutputModel;
+class CatkinManager;
+class CatkinSubProject;
+
+/**
+ * Runs package tests in parallel.
+ *
+ * The test executables of a package are built first (target "tests"),
+ * then every run_tests_<package>_<type>_<name> target found in the imported
+ * sub-project is run as a separate shard. Packages which are not imported
+ * run their run_tests_<package> target as a single shard.
+ *
+ * Shards of one package share its build directory. With the Makefile
+ * generator they run in parallel through the <target>/fast rules, which do
+ * not check any dependencies (the "tests" target already built them).
+ * Otherwise the shards of a package run one after the other.
+ *
+ * The concurrency limit counts make jobs: building the test executables
+ * gets a share of the free slots, every shard takes one.
+ *
+ * The result directory of a package is cleared before its tests run, so
+ * only fresh results are read afterwards.
+ *
+ * The affected packages are computed in a worker thread.
+ **/
+class CatkinTestJob : public KDevelop::OutputJob
+{
+Q_OBJECT
+public:
+	CatkinTestJob(CatkinManager* manager, KDevelop::IProject* workspace, QObject* parent = nullptr);
+	~CatkinTestJob() override;
+
+	//! Packages to test, the default is all packages
+	void setPackages(const QList<CatkinSubProject*>& packages);
+
+	//! Only test packages affected by changes since their last successful test run
+	void setAffectedOnly(bool affectedOnly);
+
+	//! Number of make jobs and shards running at the same time
+	void setMaximumConcurrency(int shards);
+
+	void start() override;
+
+	QVector<CatkinTestResult> results() const
+	{ return m_results; }
+Q_SIGNALS:
+	//! Emitted from the worker thread when the package selection is known
+	void prepared(QPrivateSignal);
+protected:
+	bool doKill() override;
+private:
+	struct Shard
+	{
+		QString package;
+		QString target;
+
+		//! Builds the test executables, the real shards are queued afterwards
+		bool prepare = false;
+
+		//! Make jobs used by the shard
+		int slots = 1;
+	};
+
+	struct Package
+	{
+		CatkinSubProject* project = nullptr;
+		KDevelop::Path resultDirectory;
+		//! Queued and running shards
+		int remainingShards = 0;
+		int runningShards = 0;
+
+		//! The test shards may run at the same time
+		bool parallelShards = false;
+		bool failed = false;
+	};
+
+	QStringList testTargets(CatkinSubProject* project) const;
+
+	//! Reads the dependency graph and selects the packages, runs in the worker thread
+	void prepare(const QVector<CatkinDependencyGraph::Package>& packages, const QStringList& names);
+
+	//! Continues start() in the main thread once the worker is done
+	void startTests();
+
+	void startShards();
+	void startShard(Shard shard);
+	void shardFinished(QProcess* process);
+	void packageFinished(const QString& name);
+	void report();
+
+	CatkinManager* m_manager;
+	KDevelop::IProject* m_workspace;
+
+	QList<CatkinSubProject*> m_selection;
+	bool m_affectedOnly = false;
+	int m_maxConcurrency;
+
+	QString m_cmake;
+	QProcessEnvironment m_environment;
+	CatkinBuildOutputModel* m_model = nullptr;
+	bool m_killed = false;
+
+	//! Written by the worker before prepared()
+	ThreadWeaver::Queue* m_worker;
+	std::unique_ptr<CatkinDependencyGraph> m_graph;
+	QSet<QString> m_testSelection;
+	std::unique_ptr<CatkinRebuildSet> m_affected;
+
+	QHash<QString, Package> m_packages;
+	QQueue<Shard> m_queue;
+	QHash<QProcess*, Shard> m_running;
+	int m_usedSlots = 0;
+
+	QVector<CatkinTestResult> m_results;
+	QStringList m_failed;
+};
+
+#endif
@@ -0,0 +1,85 @@
+// Results of gtest/rostest runs, read from their JUnit XML files
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkintestresult.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QXmlStreamReader>
+
+bool CatkinTestResult::read(const QString& fileName, const QString& package, QVector<CatkinTestResult>* results)
+{
+	QFile file(fileName);
+	if(!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << "Could not open test results" << fileName;
+		return false;
+	}
+
+	if(!read(&file, package, results))
+	{
+		qWarning() << "Could not parse test results" << fileName;
+		return false;
+	}
+
+	return true;
+}
+
+bool CatkinTestResult::read(QIODevice* device, const QString& package, QVector<CatkinTestResult>* results)
+{
+	QXmlStreamReader xml(device);
+	QString suite;
+
+	while(!xml.atEnd())
+	{
+		xml.readNext();
+
+		if(xml.isEndElement() && xml.name() == QLatin1String("testsuite"))
+			suite.clear();
+
+		if(!xml.isStartElement())
+			continue;
+
+		if(xml.name() == QLatin1String("testsuite"))
+		{
+			suite = xml.attributes().value(QLatin1String("name")).toString();
+			continue;
+		}
+
+		if(xml.name() != QLatin1String("testcase"))
+			continue;
+
+		const auto attributes = xml.attributes();
+
+		CatkinTestResult result;
+		result.package = package;
+		result.suite = attributes.value(QLatin1String("classname")).toString();
+		if(result.suite.isEmpty())
+			result.suite = suite;
+		result.name = attributes.value(QLatin1String("name")).toString();
+		result.time = attributes.value(QLatin1String("time")).toDouble();
+
+		// gtest marks disabled tests with status="notrun"
+		if(attributes.value(QLatin1String("status")) == QLatin1String("notrun"))
+			result.status = Skipped;
+
+		// Children: <failure>, <error>, <skipped>, <system-out>, ...
+		while(xml.readNextStartElement())
+		{
+			if(xml.name() == QLatin1String("failure") || xml.name() == QLatin1String("error"))
+			{
+				result.status = Failed;
+				if(result.message.isEmpty())
+					result.message = xml.attributes().value(QLatin1String("message")).toString();
+			}
+			else if(xml.name() == QLatin1String("skipped") && result.status != Failed)
+				result.status = Skipped;
+
+			xml.skipCurrentElement();
+		}
+
+		*results << result;
+	}
+
+	return !xml.hasError();
+}
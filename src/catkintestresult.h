@@ -0,0 +1,40 @@
+// Results of gtest/rostest runs, read from their JUnit XML files
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINTESTRESULT_H
+#define CATKINTESTRESULT_H
+
+#include <QString>
+#include <QVector>
+
+class QIODevice;
+
+struct CatkinTestResult
+{
+	enum Status
+	{
+		Passed,
+		Failed,
+		Skipped
+	};
+
+	QString package;
+	QString suite;
+	QString name;
+	Status status = Passed;
+
+	//! Seconds, as reported by the test framework
+	double time = 0.0;
+
+	//! Failure message, if any
+	QString message;
+
+	/**
+	 * Reads all <testcase> elements of a JUnit style XML file (as written
+	 * by gtest, rostest and nosetests) in a single streaming pass.
+	 **/
+	static bool read(const QString& fileName, const QString& package, QVector<CatkinTestResult>* results);
+	static bool read(QIODevice* device, const QString& package, QVector<CatkinTestResult>* results);
+};
+
+#endif
@@ -0,0 +1,178 @@
+// Tracing of the import phases, exported as Chrome trace events
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkintrace.h"
+
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QVector>
+
+namespace
+{
+	const int MAX_EVENTS = 1000000;
+
+	struct Event
+	{
+		const char* name;
+		QString detail;
+		char phase;
+		qint64 timestamp;
+		qint64 duration;
+		int thread;
+		quint64 id;
+	};
+
+	struct Recorder
+	{
+		Recorder()
+		 : fileName(QString::fromLocal8Bit(qgetenv("KDEVCATKIN_TRACE")))
+		{
+			clock.start();
+		}
+
+		const QString fileName;
+		QElapsedTimer clock;
+
+		QMutex mutex;
+		QVector<Event> events;
+		int dropped = 0;
+
+		//! The file was started by an earlier write()
+		bool started = false;
+	};
+
+	Recorder* recorder()
+	{
+		static Recorder* instance = qEnvironmentVariableIsEmpty("KDEVCATKIN_TRACE") ? nullptr : new Recorder;
+		return instance;
+	}
+
+	qint64 now(Recorder* rec)
+	{
+		return rec->clock.nsecsElapsed() / 1000;
+	}
+
+	//! Small sequential thread ids are easier to read than pthread handles
+	int threadId()
+	{
+		static QAtomicInt nextId;
+		static thread_local int id = nextId.fetchAndAddRelaxed(1);
+		return id;
+	}
+
+	void record(Recorder* rec, const Event& event)
+	{
+		QMutexLocker lock(&rec->mutex);
+		if(rec->events.size() < MAX_EVENTS)
+			rec->events << event;
+		else
+			rec->dropped++;
+	}
+}
+
+CatkinTrace::Span::Span(const char* name, const QString& detail)
+ : m_name(name)
+{
+	if(Recorder* rec = recorder())
+	{
+		m_detail = detail;
+		m_start = now(rec);
+	}
+}
+
+CatkinTrace::Span::~Span()
+{
+	if(m_start < 0)
+		return;
+
+	Recorder* rec = recorder();
+	record(rec, {m_name, m_detail, 'X', m_start, now(rec) - m_start, threadId(), 0});
+}
+
+bool CatkinTrace::isEnabled()
+{
+	return recorder();
+}
+
+quint64 CatkinTrace::newId()
+{
+	static QAtomicInteger<quint64> nextId(1);
+	return nextId.fetchAndAddRelaxed(1);
+}
+
+void CatkinTrace::begin(const char* name, quint64 id, const QString& detail)
+{
+	if(Recorder* rec = recorder())
+		record(rec, {name, detail, 'b', now(rec), 0, threadId(), id});
+}
+
+void CatkinTrace::end(const char* name, quint64 id)
+{
+	if(Recorder* rec = recorder())
+		record(rec, {name, QString(), 'e', now(rec), 0, threadId(), id});
+}
+
+bool CatkinTrace::write()
+{
+	Recorder* rec = recorder();
+	if(!rec)
+		return false;
+
+	QMutexLocker lock(&rec->mutex);
+
+	if(rec->dropped)
+	{
+		qWarning() << "Dropped" << rec->dropped << "trace events, write() was not called often enough";
+		rec->dropped = 0;
+	}
+
+	// The JSON array format, which may be left open. So every write()
+	// just appends the new events.
+	QFile file(rec->fileName);
+	if(!file.open(rec->started ? QIODevice::Append : (QIODevice::WriteOnly | QIODevice::Truncate)))
+	{
+		qWarning() << "Could not write trace to" << rec->fileName;
+		return false;
+	}
+
+	QByteArray data;
+	for(const Event& event : rec->events)
+	{
+		QJsonObject object{
+			{QStringLiteral("name"), QLatin1String(event.name)},
+			{QStringLiteral("cat"), QStringLiteral("catkin")},
+			{QStringLiteral("ph"), QString(QLatin1Char(event.phase))},
+			{QStringLiteral("ts"), event.timestamp},
+			{QStringLiteral("pid"), QCoreApplication::applicationPid()},
+			{QStringLiteral("tid"), event.thread},
+		};
+
+		if(event.phase == 'X')
+			object.insert(QStringLiteral("dur"), event.duration);
+		else
+			object.insert(QStringLiteral("id"), QString::number(event.id, 16));
+
+		if(!event.detail.isEmpty())
+			object.insert(QStringLiteral("args"), QJsonObject{{QStringLiteral("detail"), event.detail}});
+
+		data += rec->started ? ",\n" : "[\n";
+		data += QJsonDocument(object).toJson(QJsonDocument::Compact);
+		rec->started = true;
+	}
+
+	if(file.write(data) != data.size())
+	{
+		qWarning() << "Could not write trace to" << rec->fileName;
+		return false;
+	}
+
+	qDebug() << "Wrote" << rec->events.size() << "trace events to" << rec->fileName;
+	QVector<Event>().swap(rec->events);
+	return true;
+}
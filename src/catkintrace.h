@@ -0,0 +1,53 @@
+// Tracing of the import phases, exported as Chrome trace events
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINTRACE_H
+#define CATKINTRACE_H
+
+#include <QString>
+
+/**
+ * Records spans in memory and writes them as a Chrome trace JSON file,
+ * which can be opened in chrome://tracing or ui.perfetto.dev.
+ *
+ * Tracing is enabled by setting KDEVCATKIN_TRACE to the output file name.
+ * Otherwise all calls return right after checking a static flag.
+ *
+ * Scoped Span objects become complete events on the current thread, so
+ * nested spans show up nested. Work spanning several event loop
+ * iterations (jobs) uses begin() and end() with an id from newId().
+ *
+ * write() appends the events recorded since the last call to the file and
+ * drops them from memory. In between, at most a million events are kept,
+ * later ones are counted and dropped.
+ **/
+class CatkinTrace
+{
+public:
+	class Span
+	{
+	public:
+		explicit Span(const char* name, const QString& detail = QString());
+		~Span();
+
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+	private:
+		const char* m_name;
+		QString m_detail;
+		qint64 m_start = -1;
+	};
+
+	static bool isEnabled();
+
+	//! Id for begin() and end(), ids are never reused
+	static quint64 newId();
+
+	static void begin(const char* name, quint64 id, const QString& detail = QString());
+	static void end(const char* name, quint64 id);
+
+	//! Appends the events recorded since the last call to the file in KDEVCATKIN_TRACE
+	static bool write();
+};
+
+#endif
@@ -0,0 +1,224 @@
+// Multi-threaded crawler for catkin workspaces
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinworkspacecrawler.h"
+#include "catkinmanifest.h"
+
+#include <ThreadWeaver/ThreadWeaver>
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QThread>
+
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+
+CatkinWorkspaceCrawler::CatkinWorkspaceCrawler(QObject* parent)
+ : QObject(parent)
+ , m_queue(new ThreadWeaver::Queue(this))
+{
+	// Crawling is mostly waiting on the file system, so use more threads
+	// than we have cores.
+	m_queue->setMaximumNumberOfThreads(2 * QThread::idealThreadCount());
+}
+
+CatkinWorkspaceCrawler::~CatkinWorkspaceCrawler()
+{
+	// Make sure no worker touches us after destruction
+	m_queue->dequeue();
+	m_queue->finish();
+}
+
+bool CatkinWorkspaceCrawler::isPrunedDirectory(const char* name)
+{
+	// Output directories of catkin_make, catkin_make_isolated and catkin_tools
+	static const char* const PRUNED[] = {
+		"build", "devel", "install", "logs",
+		"build_isolated", "devel_isolated", "install_isolated",
+	};
+
+	for(const char* pruned : PRUNED)
+	{
+		if(strcmp(name, pruned) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool CatkinWorkspaceCrawler::loadIndex(const QString& fileName)
+{
+	return m_index.load(fileName);
+}
+
+void CatkinWorkspaceCrawler::start(const KDevelop::Path& root)
+{
+	enqueue(QFile::encodeName(root.toLocalFile()));
+}
+
+void CatkinWorkspaceCrawler::cancel()
+{
+	m_cancelled.store(1);
+
+	// Jobs still waiting in the queue never run
+	m_queue->dequeue();
+}
+
+QVector<CatkinPackageIndex::Package> CatkinWorkspaceCrawler::takePackages()
+{
+	QMutexLocker lock(&m_mutex);
+	QVector<CatkinPackageIndex::Package> ret;
+	ret.swap(m_packages);
+	return ret;
+}
+
+QVector<CatkinPackageIndex::Directory> CatkinWorkspaceCrawler::takeDirectories()
+{
+	QMutexLocker lock(&m_mutex);
+	QVector<CatkinPackageIndex::Directory> ret;
+	ret.swap(m_directories);
+	return ret;
+}
+
+void CatkinWorkspaceCrawler::enqueue(const QByteArray& path)
+{
+	m_pending.ref();
+	m_queue->enqueue(ThreadWeaver::make_job([this, path](){
+		visit(path);
+
+		if(!m_pending.deref())
+			emit finished();
+	}));
+}
+
+void CatkinWorkspaceCrawler::visit(const QByteArray& path)
+{
+	if(m_cancelled.load())
+		return;
+
+	// stat() follows symlinks, so we get the identity of the real directory
+	struct stat st;
+	if(stat(path.constData(), &st) != 0 || !S_ISDIR(st.st_mode))
+		return;
+
+	{
+		QMutexLocker lock(&m_mutex);
+		auto id = qMakePair<quint64, quint64>(st.st_dev, st.st_ino);
+		if(m_visited.contains(id))
+			return;
+		m_visited.insert(id);
+	}
+
+	CatkinPackageIndex::Directory directory;
+	directory.path = path;
+	directory.mtime = st.st_mtim.tv_sec * Q_INT64_C(1000000000) + st.st_mtim.tv_nsec;
+
+	// The directory listing only changes if the directory mtime does
+	int cached = m_index.findDirectory(path);
+	if(cached >= 0 && m_index.directoryMTime(cached) == directory.mtime)
+	{
+		directory.flags = m_index.directoryFlags(cached);
+		directory.children = m_index.directoryChildren(cached);
+	}
+	else
+		readDirectory(&directory);
+
+	if(directory.flags & CatkinPackageIndex::IsPackage)
+	{
+		// catkin packages cannot be nested, no need to descend further
+		auto pkg = package(path, cached);
+
+		bool notify;
+		{
+			QMutexLocker lock(&m_mutex);
+			notify = m_packages.isEmpty();
+			m_packages << pkg;
+			m_directories << directory;
+		}
+
+		if(notify)
+			emit packagesAvailable();
+
+		return;
+	}
+
+	{
+		QMutexLocker lock(&m_mutex);
+		m_directories << directory;
+	}
+
+	if(m_cancelled.load())
+		return;
+
+	for(const auto& subDirectory : directory.children)
+		enqueue(subDirectory);
+}
+
+void CatkinWorkspaceCrawler::readDirectory(CatkinPackageIndex::Directory* directory)
+{
+	DIR* dir = opendir(directory->path.constData());
+	if(!dir)
+		return;
+
+	while(dirent* entry = readdir(dir))
+	{
+		const char* name = entry->d_name;
+
+		if(strcmp(name, "CATKIN_IGNORE") == 0)
+		{
+			directory->flags = CatkinPackageIndex::IsIgnored;
+			directory->children.clear();
+			break;
+		}
+
+		if(strcmp(name, "package.xml") == 0)
+		{
+			directory->flags |= CatkinPackageIndex::IsPackage;
+			continue;
+		}
+
+		if(name[0] == '.' || isPrunedDirectory(name))
+			continue;
+
+		// Symlinks and unknown types are resolved by visit()
+		if(entry->d_type == DT_DIR || entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+			directory->children << directory->path + '/' + name;
+	}
+
+	closedir(dir);
+
+	if(directory->flags)
+		directory->children.clear();
+}
+
+CatkinPackageIndex::Package CatkinWorkspaceCrawler::package(const QByteArray& path, int cachedDirectory) const
+{
+	CatkinPackageIndex::Package pkg;
+	pkg.path = path;
+
+	struct stat st;
+	if(stat(QByteArray(path + "/package.xml").constData(), &st) != 0)
+		return pkg;
+
+	pkg.manifestMTime = st.st_mtim.tv_sec * Q_INT64_C(1000000000) + st.st_mtim.tv_nsec;
+	pkg.manifestSize = st.st_size;
+
+	// Reuse the parse result from the last crawl if the manifest is unchanged
+	CatkinPackageIndex::Package cached;
+	if(cachedDirectory >= 0 && m_index.package(cachedDirectory, &cached)
+		&& cached.manifestMTime == pkg.manifestMTime
+		&& cached.manifestSize == pkg.manifestSize)
+	{
+		pkg.name = cached.name;
+		pkg.buildPath = cached.buildPath;
+		return pkg;
+	}
+
+	// Parse on the worker thread, we only need the name here.
+	CatkinManifest manifest;
+	if(manifest.read(QFile::decodeName(path + "/package.xml"), CatkinManifest::NameOnly))
+		pkg.name = manifest.name;
+
+	return pkg;
+}
@@ -0,0 +1,89 @@
+// Multi-threaded crawler for catkin workspaces
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINWORKSPACECRAWLER_H
+#define CATKINWORKSPACECRAWLER_H
+
+#include "catkinpackageindex.h"
+
+#include <util/path.h>
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QVector>
+
+namespace ThreadWeaver
+{
+	class Queue;
+}
+
+/**
+ * Walks a catkin source space on a ThreadWeaver queue and reports every
+ * directory containing a package.xml.
+ *
+ * Each directory is read exactly once. Directories are identified by
+ * device/inode, so symlink loops and packages reachable through several
+ * symlinks are only visited once. The crawler does not descend into packages,
+ * CATKIN_IGNOREd directories, hidden directories and well-known output
+ * directories (see isPrunedDirectory()).
+ *
+ * Found packages are collected internally, packagesAvailable() notifies the
+ * owner (in its own thread) that takePackages() has new results.
+ *
+ * If a package index from an earlier crawl is loaded, directories whose mtime
+ * did not change are not read again, and packages whose package.xml did not
+ * change are reported with their name already filled in. Other manifests are
+ * parsed on the crawler threads, packages with an invalid manifest are
+ * reported with an empty name.
+ *
+ * cancel() stops the crawl after the directories currently being read. The
+ * results collected until then stay valid, every reported directory has been
+ * read completely.
+ **/
+class CatkinWorkspaceCrawler : public QObject
+{
+Q_OBJECT
+public:
+	explicit CatkinWorkspaceCrawler(QObject* parent = nullptr);
+	~CatkinWorkspaceCrawler() override;
+
+	bool loadIndex(const QString& fileName);
+
+	void start(const KDevelop::Path& root);
+
+	//! Stops crawling. finished() may or may not follow, disconnect from it first.
+	void cancel();
+
+	//! Returns (and forgets) the packages found so far
+	QVector<CatkinPackageIndex::Package> takePackages();
+
+	//! All visited directories, valid after finished()
+	QVector<CatkinPackageIndex::Directory> takeDirectories();
+
+	static bool isPrunedDirectory(const char* name);
+Q_SIGNALS:
+	void packagesAvailable();
+	void finished();
+private:
+	void enqueue(const QByteArray& path);
+	void visit(const QByteArray& path);
+	void readDirectory(CatkinPackageIndex::Directory* directory);
+	CatkinPackageIndex::Package package(const QByteArray& path, int cachedDirectory) const;
+
+	ThreadWeaver::Queue* m_queue;
+	CatkinPackageIndex m_index;
+
+	QMutex m_mutex;
+	QSet<QPair<quint64, quint64>> m_visited;
+	QVector<CatkinPackageIndex::Package> m_packages;
+	QVector<CatkinPackageIndex::Directory> m_directories;
+
+	QAtomicInt m_pending;
+	QAtomicInt m_cancelled;
+};
+
+#endif
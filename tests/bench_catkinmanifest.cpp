@@ -0,0 +1,131 @@
+// Micro-benchmark of the package.xml reader
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbenchmark.h"
+#include "catkinmanifest.h"
+
+#include <QBuffer>
+#include <QDomDocument>
+#include <QTest>
+
+class BenchCatkinManifest : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+	void benchDom_data();
+	void benchDom();
+
+	void benchStream_data();
+	void benchStream();
+private:
+	static void addManifests();
+
+	//! A package.xml like the ones of larger ROS packages, with @p dependencies of each kind
+	static QByteArray manifest(int dependencies);
+};
+
+QByteArray BenchCatkinManifest::manifest(int dependencies)
+{
+	QByteArray xml =
+		"<?xml version=\"1.0\"?>\n"
+		"<?xml-model href=\"http://download.ros.org/schema/package_format2.xsd\" schematypens=\"http://www.w3.org/2001/XMLSchema\"?>\n"
+		"<package format=\"2\">\n"
+		"  <name>generated_package</name>\n"
+		"  <version>1.2.3</version>\n"
+		"  <description>\n"
+		"    A generated package with a longer description, as most packages have one.\n"
+		"  </description>\n"
+		"  <maintainer email=\"nobody@example.com\">Nobody</maintainer>\n"
+		"  <license>BSD</license>\n"
+		"  <url type=\"website\">http://wiki.ros.org/generated_package</url>\n"
+		"  <author email=\"nobody@example.com\">Nobody</author>\n"
+		"  <buildtool_depend>catkin</buildtool_depend>\n";
+
+	for(int i = 0; i < dependencies; ++i)
+	{
+		xml += "  <!-- dependency " + QByteArray::number(i) + " -->\n";
+		xml += "  <depend>dependency_" + QByteArray::number(i) + "</depend>\n";
+		xml += "  <build_depend>build_dependency_" + QByteArray::number(i) + "</build_depend>\n";
+		xml += "  <exec_depend>exec_dependency_" + QByteArray::number(i) + "</exec_depend>\n";
+		xml += "  <test_depend>test_dependency_" + QByteArray::number(i) + "</test_depend>\n";
+	}
+
+	xml +=
+		"  <export>\n"
+		"    <build_type>catkin</build_type>\n"
+		"    <nodelet plugin=\"${prefix}/nodelet_plugins.xml\"/>\n"
+		"  </export>\n"
+		"</package>\n";
+
+	return xml;
+}
+
+void BenchCatkinManifest::addManifests()
+{
+	QTest::addColumn<QByteArray>("xml");
+	QTest::newRow("5 dependencies") << manifest(5);
+	QTest::newRow("50 dependencies") << manifest(50);
+}
+
+void BenchCatkinManifest::benchDom_data()
+{
+	addManifests();
+}
+
+void BenchCatkinManifest::benchDom()
+{
+	QFETCH(QByteArray, xml);
+
+	// How packages used to be read: a DOM tree just for the name
+	QString name;
+	QBENCHMARK
+	{
+		QBuffer buffer(&xml);
+		buffer.open(QIODevice::ReadOnly);
+
+		QDomDocument document;
+		QVERIFY(document.setContent(&buffer));
+		name = document.documentElement().firstChildElement(QStringLiteral("name")).text().trimmed();
+	}
+
+	QCOMPARE(name, QStringLiteral("generated_package"));
+}
+
+void BenchCatkinManifest::benchStream_data()
+{
+	QTest::addColumn<QByteArray>("xml");
+	QTest::addColumn<int>("fields");
+
+	for(int dependencies : {5, 50})
+	{
+		const QByteArray xml = manifest(dependencies);
+		QTest::newRow(qPrintable(QStringLiteral("%1 dependencies, name only").arg(dependencies)))
+			<< xml << int(CatkinManifest::NameOnly);
+		QTest::newRow(qPrintable(QStringLiteral("%1 dependencies, all fields").arg(dependencies)))
+			<< xml << int(CatkinManifest::AllFields);
+	}
+}
+
+void BenchCatkinManifest::benchStream()
+{
+	QFETCH(QByteArray, xml);
+	QFETCH(int, fields);
+
+	CatkinManifest manifest;
+	QBENCHMARK
+	{
+		QBuffer buffer(&xml);
+		buffer.open(QIODevice::ReadOnly);
+
+		manifest = CatkinManifest();
+		QVERIFY(manifest.read(&buffer, QStringLiteral("package.xml"), CatkinManifest::Fields(fields)));
+	}
+
+	QCOMPARE(manifest.name, QStringLiteral("generated_package"));
+	if(fields == CatkinManifest::AllFields)
+		QCOMPARE(manifest.buildType, QStringLiteral("catkin"));
+}
+
+CATKIN_BENCHMARK_MAIN(BenchCatkinManifest)
+
+#include "bench_catkinmanifest.moc"
@@ -0,0 +1,174 @@
+// Benchmark of routing paths to their sub-project
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbenchmark.h"
+#include "catkinpathindex.h"
+
+#include <QTest>
+
+#include <algorithm>
+
+using namespace KDevelop;
+
+class BenchCatkinPathIndex : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+	void benchFind_data();
+	void benchFind();
+
+	void benchFindRoot_data();
+	void benchFindRoot();
+
+	void benchLinearScan_data();
+	void benchLinearScan();
+private:
+	static void addSizes();
+
+	//! Package roots spread over two directory levels, like in a larger workspace
+	static QVector<Path> roots(int packages);
+
+	//! Files at different depths in each package, half of them in nested directories
+	static QVector<Path> files(const QVector<Path>& roots);
+
+	//! Stand-in for the sub-projects, the index only compares the pointers
+	static CatkinSubProject* project(int index)
+	{ return reinterpret_cast<CatkinSubProject*>(quintptr(index + 1) * 8); }
+};
+
+void BenchCatkinPathIndex::addSizes()
+{
+	QTest::addColumn<int>("packages");
+	for(int packages : {100, 1000, 5000})
+		QTest::newRow(qPrintable(QStringLiteral("%1 packages").arg(packages))) << packages;
+}
+
+QVector<Path> BenchCatkinPathIndex::roots(int packages)
+{
+	QVector<Path> roots;
+	roots.reserve(packages);
+	for(int i = 0; i < packages; ++i)
+	{
+		roots << Path(QStringLiteral("/home/user/catkin_ws/src/group_%1/stack_%2/package_%3")
+			.arg(i % 16).arg(i % 7).arg(i));
+	}
+	return roots;
+}
+
+QVector<Path> BenchCatkinPathIndex::files(const QVector<Path>& roots)
+{
+	QVector<Path> files;
+	for(const Path& root : roots)
+	{
+		files << Path(root, QStringLiteral("CMakeLists.txt"));
+		files << Path(root, QStringLiteral("src/node.cpp"));
+		files << Path(root, QStringLiteral("include/package/detail/impl.h"));
+		files << Path(root, QStringLiteral("test/unit/fixtures/data/input.txt"));
+	}
+
+	// And some outside of any package
+	files << Path(QStringLiteral("/home/user/catkin_ws/src/CMakeLists.txt"));
+	files << Path(QStringLiteral("/home/user/catkin_ws/src/group_0/README.md"));
+
+	return files;
+}
+
+void BenchCatkinPathIndex::benchFind_data()
+{
+	addSizes();
+}
+
+void BenchCatkinPathIndex::benchFind()
+{
+	QFETCH(int, packages);
+
+	const QVector<Path> packageRoots = roots(packages);
+	const QVector<Path> packageFiles = files(packageRoots);
+
+	CatkinPathIndex index;
+	for(int i = 0; i < packageRoots.size(); ++i)
+		index.insert(packageRoots[i], project(i));
+
+	int found = 0;
+	QBENCHMARK
+	{
+		found = 0;
+		for(const Path& file : packageFiles)
+		{
+			if(index.find(file))
+				found++;
+		}
+	}
+
+	QCOMPARE(found, packageFiles.size() - 2);
+}
+
+void BenchCatkinPathIndex::benchFindRoot_data()
+{
+	addSizes();
+}
+
+void BenchCatkinPathIndex::benchFindRoot()
+{
+	QFETCH(int, packages);
+
+	const QVector<Path> packageRoots = roots(packages);
+
+	CatkinPathIndex index;
+	for(int i = 0; i < packageRoots.size(); ++i)
+		index.insert(packageRoots[i], project(i));
+
+	// Every folder on the way, as when listing the workspace tree
+	QVector<Path> folders;
+	for(const Path& root : packageRoots)
+		folders << root << root.parent();
+
+	int found = 0;
+	QBENCHMARK
+	{
+		found = 0;
+		for(const Path& folder : folders)
+		{
+			if(index.findRoot(folder))
+				found++;
+		}
+	}
+
+	QCOMPARE(found, packages);
+}
+
+void BenchCatkinPathIndex::benchLinearScan_data()
+{
+	addSizes();
+}
+
+void BenchCatkinPathIndex::benchLinearScan()
+{
+	QFETCH(int, packages);
+
+	const QVector<Path> packageRoots = roots(packages);
+	const QVector<Path> packageFiles = files(packageRoots);
+
+	// The routing before the index: compare against every package root.
+	// The old code did even more per package (a model lookup), so this is
+	// a lower bound of its cost.
+	int found = 0;
+	QBENCHMARK
+	{
+		found = 0;
+		for(const Path& file : packageFiles)
+		{
+			auto it = std::find_if(packageRoots.begin(), packageRoots.end(), [&](const Path& root){
+				return root.isParentOf(file);
+			});
+			if(it != packageRoots.end())
+				found++;
+		}
+	}
+
+	QCOMPARE(found, packageFiles.size() - 2);
+}
+
+CATKIN_BENCHMARK_MAIN(BenchCatkinPathIndex)
+
+#include "bench_catkinpathindex.moc"
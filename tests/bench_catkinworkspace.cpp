@@ -0,0 +1,397 @@
+// Benchmarks of the workspace handling, on generated workspaces
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbenchmark.h"
+#include "catkinbuildinfocache.h"
+#include "catkinmanager.h"
+#include "catkinmanifest.h"
+#include "catkinstubmanager.h"
+#include "catkinsubproject.h"
+#include "catkinworkspacegenerator.h"
+
+#include <project/projectmodel.h>
+
+#include <shell/core.h>
+
+#include <tests/autotestshell.h>
+#include <tests/testcore.h>
+#include <tests/testproject.h>
+
+#include <KConfigGroup>
+#include <KJob>
+
+#include <QDir>
+#include <QTest>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+using namespace KDevelop;
+
+namespace
+{
+	//! Stand-in for a sub-project or an item, the cache only compares the pointers
+	template<class T>
+	T* fakePointer(int index)
+	{
+		return reinterpret_cast<T*>(quintptr(index + 1) * 8);
+	}
+}
+
+class BenchCatkinWorkspace : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void benchImport_data();
+	void benchImport();
+
+	void benchCreateItems_data();
+	void benchCreateItems();
+
+	void benchBuildInfo_data();
+	void benchBuildInfo();
+
+	void benchReadManifests_data();
+	void benchReadManifests();
+
+	void benchBuildInfoCacheInsert_data();
+	void benchBuildInfoCacheInsert();
+
+	void benchBuildInfoCacheLookup_data();
+	void benchBuildInfoCacheLookup();
+private:
+	//! Adds the workspace sizes as data rows
+	static void addSizes(const QList<int>& sizes = {10, 100, 1000, 5000});
+
+	/**
+	 * Imports @p project with @p manager through the stub. Unless @p lazy,
+	 * the packages are loaded in the background afterwards.
+	 **/
+	static ProjectFolderItem* import(CatkinManager* manager, TestProject* project, bool lazy);
+
+	static ProjectFileItem* findFile(ProjectFolderItem* folder, const Path& path);
+
+	//! Generated workspace with @p packages, shared between the benchmarks
+	CatkinWorkspaceGenerator* workspace(int packages);
+
+	//! Build information like the CMake imports deliver it, one per package
+	QVector<CatkinBuildInfo> buildInfos(CatkinWorkspaceGenerator* workspace);
+
+	std::map<int, std::unique_ptr<CatkinWorkspaceGenerator>> m_workspaces;
+};
+
+void BenchCatkinWorkspace::initTestCase()
+{
+	AutoTestShell::init();
+	TestCore::initialize(Core::NoUi);
+}
+
+void BenchCatkinWorkspace::cleanupTestCase()
+{
+	m_workspaces.clear();
+	TestCore::shutdown();
+}
+
+void BenchCatkinWorkspace::addSizes(const QList<int>& sizes)
+{
+	QTest::addColumn<int>("packages");
+	for(int size : sizes)
+		QTest::newRow(qPrintable(QStringLiteral("%1 packages").arg(size))) << size;
+}
+
+CatkinWorkspaceGenerator* BenchCatkinWorkspace::workspace(int packages)
+{
+	auto& workspace = m_workspaces[packages];
+	if(!workspace)
+	{
+		CatkinWorkspaceGenerator::Options options;
+		options.packages = packages;
+		options.depth = 2;
+		options.fanOut = 8;
+		options.filesPerPackage = 8;
+		options.dependencies = 3;
+		options.ignoredPackages = packages / 50;
+		options.symlinks = packages / 50;
+
+		workspace.reset(new CatkinWorkspaceGenerator(options));
+		if(!workspace->generate())
+		{
+			workspace.reset();
+			return nullptr;
+		}
+
+		// Packages without a build directory are not imported
+		for(const QString& name : workspace->packageNames())
+		{
+			if(!QDir().mkpath(Path(workspace->buildSpace(), name).toLocalFile()))
+			{
+				workspace.reset();
+				return nullptr;
+			}
+		}
+	}
+
+	return workspace.get();
+}
+
+ProjectFolderItem* BenchCatkinWorkspace::import(CatkinManager* manager, TestProject* project, bool lazy)
+{
+	// All test projects share one configuration
+	KConfigGroup group(project->projectConfiguration(), "Catkin");
+	group.writeEntry("Lazy Loading", lazy);
+
+	manager->setCMakeManager(new CatkinStubManager(0, manager));
+
+	auto root = manager->import(project);
+	if(!root)
+		return nullptr;
+
+	project->setProjectItem(root);
+	if(!manager->createImportJob(root)->exec())
+		return nullptr;
+
+	return root;
+}
+
+ProjectFileItem* BenchCatkinWorkspace::findFile(ProjectFolderItem* folder, const Path& path)
+{
+	for(auto file : folder->fileList())
+	{
+		if(file->path() == path)
+			return file;
+	}
+
+	for(auto child : folder->folderList())
+	{
+		if(child->path().isParentOf(path))
+			return findFile(child, path);
+	}
+
+	return nullptr;
+}
+
+QVector<CatkinBuildInfo> BenchCatkinWorkspace::buildInfos(CatkinWorkspaceGenerator* workspace)
+{
+	// Most of it is the same for every package
+	const Path::List common{Path(QStringLiteral("/opt/ros/noetic/include")), Path(QStringLiteral("/usr/include/eigen3"))};
+
+	QVector<CatkinBuildInfo> infos;
+	for(const QString& name : workspace->packageNames())
+	{
+		CatkinBuildInfo info;
+		info.includeDirectories = common;
+		info.includeDirectories << Path(workspace->packagePath(name), QStringLiteral("include"));
+		info.defines.insert(QStringLiteral("ROS_BUILD_SHARED_LIBS"), QStringLiteral("1"));
+		info.defines.insert(QStringLiteral("ROS_PACKAGE_NAME"), QStringLiteral("\"%1\"").arg(name));
+		info.extraArguments = QStringLiteral("-std=gnu++14");
+		infos << info;
+	}
+	return infos;
+}
+
+void BenchCatkinWorkspace::benchImport_data()
+{
+	addSizes();
+}
+
+void BenchCatkinWorkspace::benchImport()
+{
+	QFETCH(int, packages);
+	auto generated = workspace(packages);
+	QVERIFY(generated);
+
+	// The crawl and the file tree listing, in lazy mode no package is
+	// loaded. From the second round on, the crawl uses the package index.
+	int found = 0;
+	QBENCHMARK
+	{
+		// The manager goes first, it still knows the workspace
+		TestProject project(generated->sourceSpace());
+		CatkinManager manager;
+
+		QVERIFY(import(&manager, &project, true));
+		found = manager.subprojects(&project).size();
+	}
+
+	// Neither the ignored packages nor the symlinked ones a second time
+	QCOMPARE(found, packages);
+}
+
+void BenchCatkinWorkspace::benchCreateItems_data()
+{
+	addSizes();
+}
+
+void BenchCatkinWorkspace::benchCreateItems()
+{
+	QFETCH(int, packages);
+	auto generated = workspace(packages);
+	QVERIFY(generated);
+
+	TestProject project(generated->sourceSpace());
+	CatkinManager manager;
+	QVERIFY(import(&manager, &project, true));
+
+	Path::List folders;
+	Path::List files;
+	for(const QString& name : generated->packageNames())
+	{
+		folders << generated->packagePath(name) << Path(generated->packagePath(name), QStringLiteral("src"));
+		files << generated->sourceFiles(name);
+	}
+
+	// Every item is routed to its package through the path index
+	QBENCHMARK
+	{
+		for(const Path& folder : folders)
+			delete manager.createFolderItem(&project, folder, nullptr);
+		for(const Path& file : files)
+			delete manager.createFileItem(&project, file, nullptr);
+	}
+}
+
+void BenchCatkinWorkspace::benchBuildInfo_data()
+{
+	addSizes();
+}
+
+void BenchCatkinWorkspace::benchBuildInfo()
+{
+	QFETCH(int, packages);
+	auto generated = workspace(packages);
+	QVERIFY(generated);
+
+	TestProject project(generated->sourceSpace());
+	CatkinManager manager;
+	auto root = import(&manager, &project, false);
+	QVERIFY(root);
+
+	const auto subProjects = manager.subprojects(&project);
+	QCOMPARE(subProjects.size(), packages);
+	QTRY_VERIFY_WITH_TIMEOUT(std::all_of(subProjects.begin(), subProjects.end(), [](CatkinSubProject* subProject){
+		return subProject->isReady();
+	}), 600000);
+
+	QList<ProjectBaseItem*> items;
+	for(const QString& name : generated->packageNames())
+	{
+		for(const Path& file : generated->sourceFiles(name))
+		{
+			auto item = findFile(root, file);
+			QVERIFY2(item, qPrintable(file.toLocalFile()));
+			items << item;
+		}
+	}
+
+	// The first round asks the stub, the others hit the cache
+	int found = 0;
+	QBENCHMARK
+	{
+		found = 0;
+		for(auto item : items)
+		{
+			if(!manager.includeDirectories(item).isEmpty())
+				found++;
+		}
+	}
+
+	QCOMPARE(found, items.size());
+}
+
+void BenchCatkinWorkspace::benchReadManifests_data()
+{
+	addSizes();
+}
+
+void BenchCatkinWorkspace::benchReadManifests()
+{
+	QFETCH(int, packages);
+	auto generated = workspace(packages);
+	QVERIFY(generated);
+
+	QVector<QString> fileNames;
+	for(const QString& name : generated->packageNames())
+		fileNames << Path(generated->packagePath(name), QStringLiteral("package.xml")).toLocalFile();
+
+	QVector<CatkinManifest> manifests;
+	QBENCHMARK
+	{
+		manifests = CatkinManifest::readAll(fileNames);
+	}
+
+	QCOMPARE(manifests.size(), packages);
+	QCOMPARE(manifests.last().name, generated->packageNames().last());
+	QCOMPARE(manifests.last().buildDepends, generated->dependencies(manifests.last().name));
+}
+
+void BenchCatkinWorkspace::benchBuildInfoCacheInsert_data()
+{
+	addSizes();
+}
+
+void BenchCatkinWorkspace::benchBuildInfoCacheInsert()
+{
+	QFETCH(int, packages);
+	auto generated = workspace(packages);
+	QVERIFY(generated);
+
+	const QVector<CatkinBuildInfo> infos = buildInfos(generated);
+	const int files = generated->sourceFiles(generated->packageNames().first()).size();
+
+	QBENCHMARK
+	{
+		CatkinBuildInfoCache cache;
+		for(int i = 0; i < infos.size(); ++i)
+		{
+			for(int j = 0; j < files; ++j)
+				cache.insert(fakePointer<CatkinSubProject>(i), fakePointer<ProjectBaseItem>(i * files + j), infos[i]);
+		}
+	}
+}
+
+void BenchCatkinWorkspace::benchBuildInfoCacheLookup_data()
+{
+	addSizes();
+}
+
+void BenchCatkinWorkspace::benchBuildInfoCacheLookup()
+{
+	QFETCH(int, packages);
+	auto generated = workspace(packages);
+	QVERIFY(generated);
+
+	const QVector<CatkinBuildInfo> infos = buildInfos(generated);
+	const int files = generated->sourceFiles(generated->packageNames().first()).size();
+
+	CatkinBuildInfoCache cache;
+	for(int i = 0; i < infos.size(); ++i)
+	{
+		for(int j = 0; j < files; ++j)
+			cache.insert(fakePointer<CatkinSubProject>(i), fakePointer<ProjectBaseItem>(i * files + j), infos[i]);
+	}
+
+	int found = 0;
+	QBENCHMARK
+	{
+		found = 0;
+		CatkinBuildInfo info;
+		for(int i = 0; i < infos.size(); ++i)
+		{
+			for(int j = 0; j < files; ++j)
+			{
+				if(cache.lookup(fakePointer<CatkinSubProject>(i), fakePointer<ProjectBaseItem>(i * files + j), &info))
+					found++;
+			}
+		}
+	}
+
+	QCOMPARE(found, infos.size() * files);
+}
+
+CATKIN_BENCHMARK_MAIN(BenchCatkinWorkspace)
+
+#include "bench_catkinworkspace.moc"
@@ -0,0 +1,19 @@
+// Common main() of the benchmarks
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinbenchmark.h"
+
+#include <QCoreApplication>
+#include <QTest>
+
+int runCatkinBenchmark(QObject* benchmark, const QStringList& arguments)
+{
+	QStringList args = arguments;
+	if(!args.contains(QStringLiteral("-o")))
+	{
+		args << QStringLiteral("-o") << QCoreApplication::applicationName() + QStringLiteral(".xml,xml")
+			<< QStringLiteral("-o") << QStringLiteral("-,txt");
+	}
+
+	return QTest::qExec(benchmark, args);
+}
@@ -0,0 +1,25 @@
+// Common main() of the benchmarks
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINBENCHMARK_H
+#define CATKINBENCHMARK_H
+
+#include <QApplication>
+#include <QObject>
+
+/**
+ * Runs the benchmarks in @p benchmark, like QTest::qExec(). Unless an
+ * output is given with -o, the results are printed and also written as
+ * XML to <executable>.xml in the working directory, for comparing runs.
+ **/
+int runCatkinBenchmark(QObject* benchmark, const QStringList& arguments);
+
+#define CATKIN_BENCHMARK_MAIN(Benchmark) \
+int main(int argc, char** argv) \
+{ \
+	QApplication app(argc, argv); \
+	Benchmark benchmark; \
+	return runCatkinBenchmark(&benchmark, app.arguments()); \
+}
+
+#endif
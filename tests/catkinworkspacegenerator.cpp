@@ -0,0 +1,186 @@
+// Generates synthetic catkin workspaces for the tests and benchmarks
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinworkspacegenerator.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+
+namespace
+{
+	bool writeFile(const KDevelop::Path& path, const QString& contents)
+	{
+		if(!QDir().mkpath(path.parent().toLocalFile()))
+			return false;
+
+		QFile file(path.toLocalFile());
+		if(!file.open(QIODevice::WriteOnly))
+		{
+			qWarning() << "Could not write" << path.toLocalFile();
+			return false;
+		}
+
+		return file.write(contents.toUtf8()) >= 0;
+	}
+
+	QString packageName(int index)
+	{
+		return QStringLiteral("pkg_%1").arg(index, 4, 10, QLatin1Char('0'));
+	}
+}
+
+CatkinWorkspaceGenerator::CatkinWorkspaceGenerator(const Options& options)
+ : m_options(options)
+{
+}
+
+KDevelop::Path CatkinWorkspaceGenerator::root() const
+{
+	return KDevelop::Path(m_directory.path());
+}
+
+KDevelop::Path CatkinWorkspaceGenerator::sourceSpace() const
+{
+	return KDevelop::Path(root(), QStringLiteral("src"));
+}
+
+KDevelop::Path CatkinWorkspaceGenerator::buildSpace() const
+{
+	return KDevelop::Path(root(), QStringLiteral("build"));
+}
+
+bool CatkinWorkspaceGenerator::generate()
+{
+	if(!m_directory.isValid())
+		return false;
+
+	for(int i = 0; i < m_options.packages; ++i)
+	{
+		const QString name = packageName(i);
+
+		// Spread the packages over the directory levels
+		QString directory;
+		int index = i;
+		for(int level = 0; level < m_options.depth; ++level)
+		{
+			directory.prepend(QStringLiteral("group_%1/").arg(index % qMax(1, m_options.fanOut)));
+			index /= qMax(1, m_options.fanOut);
+		}
+
+		QStringList dependencies;
+		for(int k = 0; k < m_options.dependencies && (1 << k) <= i; ++k)
+			dependencies << packageName(i - (1 << k));
+
+		KDevelop::Path path(sourceSpace(), directory + name);
+		if(!writePackage(path, name, dependencies))
+			return false;
+
+		m_names << name;
+		m_paths.insert(name, path);
+		m_dependencies.insert(name, dependencies);
+	}
+
+	for(int i = 0; i < m_options.ignoredPackages; ++i)
+	{
+		KDevelop::Path ignored(sourceSpace(), QStringLiteral("ignored_%1").arg(i));
+		if(!writeFile(KDevelop::Path(ignored, QStringLiteral("CATKIN_IGNORE")), QString()))
+			return false;
+
+		if(!writePackage(KDevelop::Path(ignored, QStringLiteral("pkg")), QStringLiteral("ignored_%1").arg(i), {}))
+			return false;
+	}
+
+	if(m_options.symlinks > 0)
+	{
+		KDevelop::Path links(sourceSpace(), QStringLiteral("links"));
+		if(!QDir().mkpath(links.toLocalFile()))
+			return false;
+
+		for(int i = 0; i < m_options.symlinks && !m_names.isEmpty(); ++i)
+		{
+			const KDevelop::Path target = m_paths.value(m_names[i % m_names.size()]);
+			if(!QFile::link(target.toLocalFile(), KDevelop::Path(links, QStringLiteral("link_%1").arg(i)).toLocalFile()))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool CatkinWorkspaceGenerator::writePackage(const KDevelop::Path& path, const QString& name, const QStringList& dependencies)
+{
+	QString manifest = QStringLiteral(
+		"<?xml version=\"1.0\"?>\n"
+		"<package format=\"2\">\n"
+		"  <name>%1</name>\n"
+		"  <version>0.0.1</version>\n"
+		"  <description>Generated package</description>\n"
+		"  <maintainer email=\"nobody@example.com\">Nobody</maintainer>\n"
+		"  <license>BSD</license>\n"
+	).arg(name);
+
+	for(const QString& dependency : dependencies)
+		manifest += QStringLiteral("  <build_depend>%1</build_depend>\n").arg(dependency);
+
+	manifest += QStringLiteral(
+		"  <export>\n"
+		"    <build_type>cmake</build_type>\n"
+		"  </export>\n"
+		"</package>\n"
+	);
+
+	if(!writeFile(KDevelop::Path(path, QStringLiteral("package.xml")), manifest))
+		return false;
+
+	QStringList sources;
+	for(int i = 0; i < m_options.filesPerPackage; ++i)
+	{
+		const QString function = QStringLiteral("%1_file_%2").arg(name).arg(i);
+
+		const QString header = QStringLiteral("include/%1/file_%2.h").arg(name).arg(i);
+		if(!writeFile(KDevelop::Path(path, header), QStringLiteral("int %1();\n").arg(function)))
+			return false;
+
+		const QString source = QStringLiteral("src/file_%1.cpp").arg(i);
+		const QString contents = QStringLiteral(
+			"#include <%1/file_%2.h>\n"
+			"\n"
+			"int %3()\n"
+			"{\n"
+			"  return %2;\n"
+			"}\n"
+		).arg(name).arg(i).arg(function);
+
+		if(!writeFile(KDevelop::Path(path, source), contents))
+			return false;
+
+		sources << source;
+	}
+
+	// Without sources there is nothing to put into the library
+	QString cmake = QStringLiteral(
+		"cmake_minimum_required(VERSION 3.0)\n"
+		"project(%1 CXX)\n"
+	).arg(name);
+
+	if(!sources.isEmpty())
+	{
+		cmake += QStringLiteral(
+			"add_library(%1 STATIC %2)\n"
+			"target_include_directories(%1 PUBLIC include)\n"
+		).arg(name, sources.join(QLatin1Char(' ')));
+	}
+
+	return writeFile(KDevelop::Path(path, QStringLiteral("CMakeLists.txt")), cmake);
+}
+
+KDevelop::Path::List CatkinWorkspaceGenerator::sourceFiles(const QString& name) const
+{
+	KDevelop::Path::List files;
+	const KDevelop::Path path = packagePath(name);
+	for(int i = 0; i < m_options.filesPerPackage; ++i)
+		files << KDevelop::Path(path, QStringLiteral("src/file_%1.cpp").arg(i));
+
+	return files;
+}
@@ -0,0 +1,78 @@
+// Generates synthetic catkin workspaces for the tests and benchmarks
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#ifndef CATKINWORKSPACEGENERATOR_H
+#define CATKINWORKSPACEGENERATOR_H
+
+#include <util/path.h>
+
+#include <QHash>
+#include <QStringList>
+#include <QTemporaryDir>
+
+/**
+ * Writes a workspace with a source space (src) to a temporary directory,
+ * which is removed again with the generator.
+ *
+ * Package i is called pkg_<i> and depends on the packages i - 1, i - 2,
+ * i - 4, ... (as many as Options::dependencies). The packages are plain
+ * CMake projects, each building a static library from its sources, so the
+ * workspace builds without catkin.
+ *
+ * CATKIN_IGNOREd packages and symlinks to packages are not part of
+ * packageNames(), a crawl has to skip them.
+ **/
+class CatkinWorkspaceGenerator
+{
+public:
+	struct Options
+	{
+		int packages = 10;
+
+		//! Directory levels between the source space and the packages
+		int depth = 1;
+
+		//! Directories per level
+		int fanOut = 4;
+
+		int filesPerPackage = 4;
+		int dependencies = 2;
+
+		//! Additional packages in CATKIN_IGNOREd directories
+		int ignoredPackages = 0;
+
+		//! Symlinks to package directories
+		int symlinks = 0;
+	};
+
+	explicit CatkinWorkspaceGenerator(const Options& options = Options());
+
+	bool generate();
+
+	KDevelop::Path root() const;
+	KDevelop::Path sourceSpace() const;
+	KDevelop::Path buildSpace() const;
+
+	QStringList packageNames() const
+	{ return m_names; }
+
+	KDevelop::Path packagePath(const QString& name) const
+	{ return m_paths.value(name); }
+
+	QStringList dependencies(const QString& name) const
+	{ return m_dependencies.value(name); }
+
+	//! The .cpp files of @p name
+	KDevelop::Path::List sourceFiles(const QString& name) const;
+private:
+	bool writePackage(const KDevelop::Path& path, const QString& name, const QStringList& dependencies);
+
+	Options m_options;
+	QTemporaryDir m_directory;
+
+	QStringList m_names;
+	QHash<QString, KDevelop::Path> m_paths;
+	QHash<QString, QStringList> m_dependencies;
+};
+
+#endif
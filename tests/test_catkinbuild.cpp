@@ -0,0 +1,268 @@
+// Tests of the parts of the build engine, on a generated workspace
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkindependencygraph.h"
+#include "catkinjobserver.h"
+#include "catkinmanager.h"
+#include "catkinstubmanager.h"
+#include "catkinworkspacegenerator.h"
+
+#include <project/interfaces/iprojectbuilder.h>
+#include <project/projectmodel.h>
+
+#include <shell/core.h>
+
+#include <tests/autotestshell.h>
+#include <tests/testcore.h>
+#include <tests/testproject.h>
+
+#include <KJob>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTest>
+
+#include <algorithm>
+
+using namespace KDevelop;
+
+class TestCatkinBuild : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void testDependencyGraph();
+	void testDependencyCycle();
+	void testJobServer();
+	void testJobServerInheritance();
+	void testBuildWorkspace();
+private:
+	static QVector<CatkinDependencyGraph::Package> packages(const CatkinWorkspaceGenerator& workspace);
+
+	//! Package names in an order the build job could start them
+	static QStringList buildOrder(const CatkinDependencyGraph& graph);
+};
+
+void TestCatkinBuild::initTestCase()
+{
+	AutoTestShell::init();
+	TestCore::initialize(Core::NoUi);
+}
+
+void TestCatkinBuild::cleanupTestCase()
+{
+	TestCore::shutdown();
+}
+
+QVector<CatkinDependencyGraph::Package> TestCatkinBuild::packages(const CatkinWorkspaceGenerator& workspace)
+{
+	QVector<CatkinDependencyGraph::Package> packages;
+	for(const QString& name : workspace.packageNames())
+		packages << CatkinDependencyGraph::Package{nullptr, workspace.packagePath(name), KDevelop::Path(workspace.buildSpace(), name)};
+
+	return packages;
+}
+
+QStringList TestCatkinBuild::buildOrder(const CatkinDependencyGraph& graph)
+{
+	QStringList order;
+	QStringList pending = graph.packageNames();
+	while(!pending.isEmpty())
+	{
+		auto it = std::find_if(pending.begin(), pending.end(), [&](const QString& name){
+			for(const QString& dependency : graph.dependencies(name))
+			{
+				if(!order.contains(dependency))
+					return false;
+			}
+			return true;
+		});
+
+		if(it == pending.end())
+			return QStringList();
+
+		order << *it;
+		pending.erase(it);
+	}
+	return order;
+}
+
+void TestCatkinBuild::testDependencyGraph()
+{
+	CatkinWorkspaceGenerator::Options options;
+	options.packages = 20;
+	options.dependencies = 3;
+	options.ignoredPackages = 2;
+
+	CatkinWorkspaceGenerator workspace(options);
+	QVERIFY(workspace.generate());
+
+	CatkinDependencyGraph graph(packages(workspace));
+
+	QStringList names = graph.packageNames();
+	names.sort();
+	QCOMPARE(names, workspace.packageNames());
+
+	for(const QString& name : workspace.packageNames())
+	{
+		QStringList dependencies = graph.dependencies(name);
+		QStringList expected = workspace.dependencies(name);
+		dependencies.sort();
+		expected.sort();
+		QCOMPARE(dependencies, expected);
+
+		for(const QString& dependency : expected)
+			QVERIFY(graph.dependents(dependency).contains(name));
+	}
+
+	// pkg_0005 depends on 4, 3 and 1, which reach everything below
+	QCOMPARE(graph.dependencyClosure({QStringLiteral("pkg_0005")}).size(), 6);
+	QCOMPARE(graph.dependencyClosure({QStringLiteral("pkg_0000"), QStringLiteral("unknown")}).size(), 1);
+
+	QCOMPARE(buildOrder(graph).size(), options.packages);
+}
+
+void TestCatkinBuild::testDependencyCycle()
+{
+	CatkinWorkspaceGenerator::Options options;
+	options.packages = 6;
+	options.dependencies = 1;
+
+	CatkinWorkspaceGenerator workspace(options);
+	QVERIFY(workspace.generate());
+
+	CatkinDependencyGraph acyclic(packages(workspace));
+	QVERIFY(acyclic.cyclicPackages(acyclic.dependencyClosure(acyclic.packageNames())).isEmpty());
+
+	// pkg_0002 depends on pkg_0001 already, close the cycle
+	QFile manifest(KDevelop::Path(workspace.packagePath(QStringLiteral("pkg_0001")), QStringLiteral("package.xml")).toLocalFile());
+	QVERIFY(manifest.open(QIODevice::ReadOnly));
+	QByteArray contents = manifest.readAll();
+	manifest.close();
+
+	contents.replace("<build_depend>pkg_0000</build_depend>", "<build_depend>pkg_0002</build_depend>");
+	QVERIFY(manifest.open(QIODevice::WriteOnly | QIODevice::Truncate));
+	QVERIFY(manifest.write(contents) == contents.size());
+	manifest.close();
+
+	CatkinDependencyGraph graph(packages(workspace));
+
+	// The cycle and everything behind it, but not what it depends on
+	const QStringList cyclic{
+		QStringLiteral("pkg_0001"), QStringLiteral("pkg_0002"), QStringLiteral("pkg_0003"),
+		QStringLiteral("pkg_0004"), QStringLiteral("pkg_0005")
+	};
+	QCOMPARE(graph.cyclicPackages(graph.dependencyClosure(graph.packageNames())), cyclic);
+
+	// Outside of the selection, the cycle does not matter
+	QVERIFY(graph.cyclicPackages({QStringLiteral("pkg_0000"), QStringLiteral("pkg_0001")}).isEmpty());
+}
+
+void TestCatkinBuild::testJobServer()
+{
+	CatkinJobServer server(2);
+	QVERIFY(server.isValid());
+	QVERIFY(server.makeFlags().startsWith(QLatin1String("-j --jobserver-fds=")));
+
+	QVERIFY(server.tryAcquire());
+	QVERIFY(server.tryAcquire());
+	QVERIFY(!server.tryAcquire());
+
+	QSignalSpy spy(&server, &CatkinJobServer::tokensAvailable);
+	server.release();
+	QVERIFY(spy.wait(1000));
+
+	QVERIFY(server.tryAcquire());
+	QVERIFY(!server.tryAcquire());
+}
+
+void TestCatkinBuild::testJobServerInheritance()
+{
+	CatkinJobServer server(2);
+	QVERIFY(server.isValid());
+
+	const QRegularExpressionMatch fds = QRegularExpression(QStringLiteral("--jobserver-fds=(\\d+),(\\d+)")).match(server.makeFlags());
+	QVERIFY(fds.hasMatch());
+
+	// Succeeds if the shell got both ends of the pipe
+	const QStringList arguments{
+		QStringLiteral("-c"),
+		QStringLiteral("test -e /proc/$$/fd/%1 && test -e /proc/$$/fd/%2").arg(fds.captured(1), fds.captured(2))
+	};
+
+	QProcess plain;
+	plain.start(QStringLiteral("/bin/sh"), arguments);
+	QVERIFY(plain.waitForFinished());
+	QCOMPARE(plain.exitCode(), 1);
+
+	CatkinJobServerProcess build(&server);
+	build.start(QStringLiteral("/bin/sh"), arguments);
+	QVERIFY(build.waitForFinished());
+	QCOMPARE(build.exitCode(), 0);
+}
+
+void TestCatkinBuild::testBuildWorkspace()
+{
+	if(QStandardPaths::findExecutable(QStringLiteral("cmake")).isEmpty() || QStandardPaths::findExecutable(QStringLiteral("make")).isEmpty())
+		QSKIP("cmake and make are needed to build the workspace");
+
+	CatkinWorkspaceGenerator::Options options;
+	options.packages = 4;
+	options.filesPerPackage = 8;
+
+	CatkinWorkspaceGenerator generator(options);
+	QVERIFY(generator.generate());
+
+	// Packages without a build directory are not imported
+	for(const QString& name : generator.packageNames())
+		QVERIFY(QDir().mkpath(Path(generator.buildSpace(), name).toLocalFile()));
+
+	// The manager goes first, it still knows the workspace
+	TestProject workspace(generator.sourceSpace());
+
+	CatkinManager manager;
+	manager.setCMakeManager(new CatkinStubManager(0, &manager));
+
+	auto root = manager.import(&workspace);
+	QVERIFY(root);
+	workspace.setProjectItem(root);
+	QVERIFY(manager.createImportJob(root)->exec());
+	QCOMPARE(manager.subprojects(&workspace).size(), options.packages);
+
+	auto libraries = [&](){
+		QHash<QString, QDateTime> ret;
+		for(const QString& name : generator.packageNames())
+		{
+			const QFileInfo library(Path(generator.buildSpace(), name + QStringLiteral("/lib%1.a").arg(name)).toLocalFile());
+			if(library.exists())
+				ret.insert(name, library.lastModified());
+		}
+		return ret;
+	};
+
+	// Configures and builds every package, in dependency order
+	KJob* job = manager.builder()->build(root);
+	QVERIFY(job);
+	QVERIFY2(job->exec(), qPrintable(job->errorString()));
+
+	const auto built = libraries();
+	QCOMPARE(built.size(), options.packages);
+
+	// The build stamps are written, nothing changed since
+	job = manager.builder()->build(root);
+	QVERIFY(job);
+	QVERIFY2(job->exec(), qPrintable(job->errorString()));
+	QCOMPARE(libraries(), built);
+}
+
+QTEST_MAIN(TestCatkinBuild)
+
+#include "test_catkinbuild.moc"
@@ -0,0 +1,85 @@
+// Tests of the CMakeCache.txt reader
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkincmakecache.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+class TestCatkinCMakeCache : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+	void testValues();
+	void testGenerator();
+	void testNotConfigured();
+private:
+	static bool writeCache(const QString& directory, const QByteArray& contents);
+};
+
+bool TestCatkinCMakeCache::writeCache(const QString& directory, const QByteArray& contents)
+{
+	QFile file(directory + QStringLiteral("/CMakeCache.txt"));
+	return file.open(QIODevice::WriteOnly) && file.write(contents) == contents.size();
+}
+
+void TestCatkinCMakeCache::testValues()
+{
+	QTemporaryDir directory;
+	QVERIFY(directory.isValid());
+
+	QVERIFY(writeCache(directory.path(),
+		"# This is the CMakeCache file.\n"
+		"//Name of generator.\n"
+		"CMAKE_GENERATOR:INTERNAL=Unix Makefiles\n"
+		"CMAKE_CXX_COMPILER:FILEPATH=/usr/bin/c++\r\n"
+		"CMAKE_HOME_DIRECTORY:INTERNAL=/home/user/ws/src/pkg\n"
+		"CMAKE_CACHEFILE_DIR:INTERNAL=/home/user/ws/build/pkg\n"
+		"CATKIN_TEST_RESULTS_DIR:PATH=/home/user/ws/build/test_results\n"
+		"SOME_OTHER_VARIABLE:STRING=ignored\n"
+	));
+
+	CatkinCMakeCache cache;
+	const KDevelop::Path buildDirectory(directory.path());
+
+	// Read by the build and test jobs to decide on the jobserver and /fast shards
+	QCOMPARE(cache.value(buildDirectory, "CMAKE_GENERATOR"), QStringLiteral("Unix Makefiles"));
+	QCOMPARE(cache.value(buildDirectory, "CMAKE_HOME_DIRECTORY"), QStringLiteral("/home/user/ws/src/pkg"));
+	QCOMPARE(cache.value(buildDirectory, "CMAKE_CACHEFILE_DIR"), QStringLiteral("/home/user/ws/build/pkg"));
+	QCOMPARE(cache.value(buildDirectory, "CATKIN_TEST_RESULTS_DIR"), QStringLiteral("/home/user/ws/build/test_results"));
+	QCOMPARE(cache.value(buildDirectory, "SOME_OTHER_VARIABLE"), QString());
+	QCOMPARE(cache.compiler(buildDirectory), KDevelop::Path(QStringLiteral("/usr/bin/c++")));
+}
+
+void TestCatkinCMakeCache::testGenerator()
+{
+	QTemporaryDir makefiles;
+	QTemporaryDir ninja;
+	QVERIFY(makefiles.isValid() && ninja.isValid());
+
+	QVERIFY(writeCache(makefiles.path(), "CMAKE_GENERATOR:INTERNAL=Unix Makefiles\n"));
+	QVERIFY(writeCache(ninja.path(), "CMAKE_GENERATOR:INTERNAL=Ninja\n"));
+
+	// The test job runs the shards of a package in parallel only with /fast targets
+	CatkinCMakeCache cache;
+	QVERIFY(cache.usesMakefiles(KDevelop::Path(makefiles.path())));
+	QVERIFY(!cache.usesMakefiles(KDevelop::Path(ninja.path())));
+}
+
+void TestCatkinCMakeCache::testNotConfigured()
+{
+	QTemporaryDir directory;
+	QVERIFY(directory.isValid());
+
+	CatkinCMakeCache cache;
+	const KDevelop::Path buildDirectory(directory.path());
+
+	QCOMPARE(cache.value(buildDirectory, "CMAKE_GENERATOR"), QString());
+	QVERIFY(!cache.compiler(buildDirectory).isValid());
+	QVERIFY(!cache.usesMakefiles(buildDirectory));
+}
+
+QTEST_GUILESS_MAIN(TestCatkinCMakeCache)
+
+#include "test_catkincmakecache.moc"
@@ -0,0 +1,88 @@
+// Tests of the workspace crawler and its package index
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinpackageindex.h"
+#include "catkinworkspacecrawler.h"
+#include "catkinworkspacegenerator.h"
+
+#include <QAtomicInt>
+#include <QEventLoop>
+#include <QTemporaryDir>
+#include <QTest>
+
+class TestCatkinCrawler : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+	void testResumeCancelledCrawl();
+private:
+	//! Package names found by a complete crawl of @p root, which updates the index
+	static QStringList crawl(const KDevelop::Path& root, const QString& indexFileName);
+};
+
+QStringList TestCatkinCrawler::crawl(const KDevelop::Path& root, const QString& indexFileName)
+{
+	CatkinWorkspaceCrawler crawler;
+	if(!crawler.loadIndex(indexFileName))
+		return QStringList();
+
+	QEventLoop loop;
+	connect(&crawler, &CatkinWorkspaceCrawler::finished, &loop, &QEventLoop::quit, Qt::QueuedConnection);
+	crawler.start(root);
+	loop.exec();
+
+	const auto packages = crawler.takePackages();
+	if(!CatkinPackageIndex::save(indexFileName, crawler.takeDirectories(), packages))
+		return QStringList();
+
+	QStringList names;
+	for(const auto& package : packages)
+		names << package.name;
+	names.sort();
+	return names;
+}
+
+void TestCatkinCrawler::testResumeCancelledCrawl()
+{
+	CatkinWorkspaceGenerator::Options options;
+	options.packages = 200;
+	options.depth = 2;
+	options.fanOut = 8;
+	options.filesPerPackage = 1;
+
+	CatkinWorkspaceGenerator workspace(options);
+	QVERIFY(workspace.generate());
+
+	QTemporaryDir cache;
+	QVERIFY(cache.isValid());
+	const QString indexFileName = cache.path() + QStringLiteral("/packages.index");
+
+	// Kill the crawl at the first package and keep the index, the way the
+	// import job does
+	{
+		CatkinWorkspaceCrawler crawler;
+
+		QAtomicInt cancelled;
+		connect(&crawler, &CatkinWorkspaceCrawler::packagesAvailable, &crawler, [&](){
+			crawler.cancel();
+			cancelled.store(1);
+		}, Qt::DirectConnection);
+
+		crawler.start(workspace.sourceSpace());
+		QTRY_VERIFY_WITH_TIMEOUT(cancelled.load(), 10000);
+
+		const auto packages = crawler.takePackages();
+		QVERIFY(packages.size() < options.packages);
+		QVERIFY(CatkinPackageIndex::save(indexFileName, crawler.takeDirectories(), packages));
+	}
+
+	// The resumed crawl trusts the index only where the first one got to
+	QCOMPARE(crawl(workspace.sourceSpace(), indexFileName), workspace.packageNames());
+
+	// Everything comes from the complete index now
+	QCOMPARE(crawl(workspace.sourceSpace(), indexFileName), workspace.packageNames());
+}
+
+QTEST_GUILESS_MAIN(TestCatkinCrawler)
+
+#include "test_catkincrawler.moc"
@@ -0,0 +1,134 @@
+// Imports a generated workspace, with the stub instead of the CMake manager
+// Author: Max Schwarz <max.schwarz@online.de>
+
+#include "catkinmanager.h"
+#include "catkinstubmanager.h"
+#include "catkinsubproject.h"
+#include "catkinworkspacegenerator.h"
+
+#include <project/projectmodel.h>
+
+#include <shell/core.h>
+
+#include <tests/autotestshell.h>
+#include <tests/testcore.h>
+#include <tests/testproject.h>
+
+#include <KJob>
+
+#include <QDir>
+#include <QFile>
+#include <QTest>
+
+#include <algorithm>
+
+using namespace KDevelop;
+
+class TestCatkinImport : public QObject
+{
+Q_OBJECT
+private Q_SLOTS:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void testImport();
+private:
+	static ProjectFileItem* findFile(ProjectFolderItem* folder, const Path& path);
+};
+
+void TestCatkinImport::initTestCase()
+{
+	AutoTestShell::init();
+	TestCore::initialize(Core::NoUi);
+}
+
+void TestCatkinImport::cleanupTestCase()
+{
+	TestCore::shutdown();
+}
+
+ProjectFileItem* TestCatkinImport::findFile(ProjectFolderItem* folder, const Path& path)
+{
+	for(auto file : folder->fileList())
+	{
+		if(file->path() == path)
+			return file;
+	}
+
+	for(auto child : folder->folderList())
+	{
+		if(child->path().isParentOf(path))
+			return findFile(child, path);
+	}
+
+	return nullptr;
+}
+
+void TestCatkinImport::testImport()
+{
+	CatkinWorkspaceGenerator::Options options;
+	options.packages = 12;
+	options.depth = 2;
+	options.ignoredPackages = 2;
+	options.symlinks = 2;
+
+	CatkinWorkspaceGenerator generator(options);
+	QVERIFY(generator.generate());
+
+	// Packages without a build directory are not imported
+	for(const QString& name : generator.packageNames())
+		QVERIFY(QDir().mkpath(Path(generator.buildSpace(), name).toLocalFile()));
+
+	// The manager goes first, it still knows the workspace
+	TestProject workspace(generator.sourceSpace());
+
+	CatkinManager manager;
+	manager.setCMakeManager(new CatkinStubManager(10, &manager));
+
+	auto root = manager.import(&workspace);
+	QVERIFY(root);
+	workspace.setProjectItem(root);
+
+	KJob* job = manager.createImportJob(root);
+	QVERIFY(job->exec());
+
+	// Neither the ignored packages nor the symlinked ones a second time
+	QStringList names;
+	for(auto project : manager.subprojects(&workspace))
+		names << project->name();
+	names.sort();
+	QCOMPARE(names, generator.packageNames());
+
+	QTRY_VERIFY_WITH_TIMEOUT(std::all_of(names.begin(), names.end(), [&](const QString& name){
+		auto project = manager.subprojectForPath(generator.packagePath(name));
+		return project && project->isReady();
+	}), 10000);
+
+	// The build information is routed to the stub
+	for(const QString& name : generator.packageNames())
+	{
+		const Path source = generator.sourceFiles(name).first();
+
+		auto file = findFile(root, source);
+		QVERIFY2(file, qPrintable(source.toLocalFile()));
+		QVERIFY(manager.hasBuildInfo(file));
+		QVERIFY(manager.defines(file).contains(QStringLiteral("KDEVCATKIN_STUB")));
+	}
+
+	// Build directories follow the CMake cache of the package
+	const QString name = generator.packageNames().first();
+	const Path source = generator.sourceFiles(name).first();
+	const Path binaryDir(generator.root(), QStringLiteral("elsewhere"));
+
+	QFile cache(Path(generator.buildSpace(), name + QStringLiteral("/CMakeCache.txt")).toLocalFile());
+	QVERIFY(cache.open(QIODevice::WriteOnly));
+	cache.write("CMAKE_CACHEFILE_DIR:INTERNAL=" + binaryDir.toLocalFile().toUtf8() + '\n');
+	cache.write("CMAKE_HOME_DIRECTORY:INTERNAL=" + generator.packagePath(name).toLocalFile().toUtf8() + '\n');
+	cache.close();
+
+	QCOMPARE(manager.buildDirectory(findFile(root, source)), Path(binaryDir, QStringLiteral("src")));
+}
+
+QTEST_MAIN(TestCatkinImport)
+
+#include "test_catkinimport.moc"